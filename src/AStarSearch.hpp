@@ -0,0 +1,177 @@
+#pragma once
+
+#include "Graph.hpp"
+#include "DirectedGraph.hpp"
+#include "BinaryHeap.hpp"
+#include "Timer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// the outcome of a point to point search, with the numbers needed to compare search algorithms
+struct SearchResult
+{
+    std::vector<uint32_t> path;         // nodes of the graph from start to goal, empty if the goal can't be reached
+    double  cost = std::numeric_limits<double>::infinity();    // travel time in seconds
+    double  length = 0;                 // length of the path in meters
+    size_t  settled = 0;                // nodes taken off the open lists
+    size_t  settledBackward = 0;        // of those, the ones settled searching backwards from the goal
+    double  millis = 0;
+
+    bool found() const
+    {
+        return !path.empty();
+    }
+};
+
+// a lower bound on the travel time from any position to the goal: the straight line distance at
+// the map's smallest east west scale, covered at the fastest speed of the profile. no path can be
+// shorter than its straight line at that scale, so the bound is admissible and consistent
+class StraightLineHeuristic
+{
+    sf::Vector2f    m_goal;
+    double          m_cosLatitude;
+    double          m_secondsPerDegree;
+
+public:
+
+    StraightLineHeuristic(const Graph& graph, const DirectedGraph& directed, const sf::Vector2f& goal)
+        : m_goal(goal)
+        , m_cosLatitude(graph.getMinCosLatitude())
+    {
+        // slightly below the true bound, so float rounding in the edge weights can't make it inadmissible
+        const double maxSpeed = std::max(1e-3f, directed.getMaxSpeed());
+        m_secondsPerDegree = Graph::MetersPerDegree / maxSpeed * (1.0 - 1e-5);
+    }
+
+    float operator()(const sf::Vector2f& p) const
+    {
+        double dx = (double(m_goal.x) - double(p.x)) * m_cosLatitude;
+        double dy = double(m_goal.y) - double(p.y);
+        return float(std::sqrt(dx * dx + dy * dy) * m_secondsPerDegree);
+    }
+};
+
+// point to point A* over the forward edges of one travel mode
+//
+// the per node search state is only valid where its timestamp is the current query's, so each
+// query starts by incrementing the timestamp instead of clearing arrays as large as the graph
+// the engine keeps its arrays between queries, one engine is meant to serve all of a map's queries
+class AStarSearch
+{
+    static constexpr uint32_t None = UINT32_MAX;
+
+    std::vector<float>      m_dist;
+    std::vector<uint32_t>   m_parent;           // the node a node was reached from
+    std::vector<uint32_t>   m_parentEdge;       // and the forward edge it was reached by
+    std::vector<uint32_t>   m_stamp;
+    uint32_t                m_currentStamp = 0;
+    BinaryHeap              m_open;
+
+public:
+
+    // with useHeuristic false this is dijkstra's algorithm, which settles every node closer than the goal
+    SearchResult search(const Graph& graph, const DirectedGraph& directed, uint32_t start, uint32_t goal, bool useHeuristic = true)
+    {
+        if (!useHeuristic) { return searchWith(graph, directed, start, goal, [](uint32_t) { return 0.0f; }); }
+
+        const StraightLineHeuristic heuristic(graph, directed, graph.position(goal));
+        return searchWith(graph, directed, start, goal, [&](uint32_t n) { return heuristic(graph.position(n)); });
+    }
+
+    // h(node) has to be a consistent lower bound on the travel time from the node to the goal
+    template <class Heuristic>
+    SearchResult searchWith(const Graph& graph, const DirectedGraph& directed, uint32_t start, uint32_t goal, Heuristic h)
+    {
+        Timer timer;
+        SearchResult result;
+        startQuery(graph.numNodes());
+
+        const DirectedGraph::Adjacency& forward = directed.forward();
+
+        reach(start, 0.0f, None, None);
+        m_open.push(start, h(start));
+        while (!m_open.empty())
+        {
+            const uint32_t n = m_open.pop();
+            result.settled++;
+            if (n == goal) { break; }
+
+            const float g = m_dist[n];
+            for (uint32_t e = forward.beginEdge(n); e < forward.endEdge(n); e++)
+            {
+                const uint32_t t = forward.target(e);
+                const float d = g + forward.weight(e);
+                if (m_stamp[t] == m_currentStamp && d >= m_dist[t]) { continue; }
+
+                reach(t, d, n, e);
+                m_open.push(t, d + h(t));
+            }
+        }
+
+        if (isReached(goal)) { result = tracePath(graph, forward, goal, result.settled); }
+        m_open.clear();
+        result.millis = timer.getElapsedMillis();
+        return result;
+    }
+
+    size_t getMemoryBytes() const
+    {
+        return m_dist.capacity() * sizeof(float) + (m_parent.capacity() + m_parentEdge.capacity() + m_stamp.capacity()) * sizeof(uint32_t)
+             + m_open.getMemoryBytes();
+    }
+
+private:
+
+    void startQuery(size_t numNodes)
+    {
+        if (m_stamp.size() != numNodes)
+        {
+            m_dist.assign(numNodes, 0.0f);
+            m_parent.assign(numNodes, None);
+            m_parentEdge.assign(numNodes, None);
+            m_stamp.assign(numNodes, 0);
+            m_open.resize(numNodes);
+            m_currentStamp = 0;
+        }
+
+        // after 4 billion queries the stamps wrap around, which is the only time they are cleared
+        if (++m_currentStamp == 0)
+        {
+            std::fill(m_stamp.begin(), m_stamp.end(), 0);
+            m_currentStamp = 1;
+        }
+    }
+
+    void reach(uint32_t node, float dist, uint32_t parent, uint32_t parentEdge)
+    {
+        m_stamp[node] = m_currentStamp;
+        m_dist[node] = dist;
+        m_parent[node] = parent;
+        m_parentEdge[node] = parentEdge;
+    }
+
+    bool isReached(uint32_t node) const
+    {
+        return m_stamp[node] == m_currentStamp;
+    }
+
+    // walks the parents back from the goal
+    SearchResult tracePath(const Graph& graph, const DirectedGraph::Adjacency& forward, uint32_t goal, size_t settled) const
+    {
+        SearchResult result;
+        result.settled = settled;
+        result.cost = m_dist[goal];
+
+        for (uint32_t n = goal; n != None; n = m_parent[n])
+        {
+            result.path.push_back(n);
+            if (m_parentEdge[n] != None) { result.length += graph.length(forward.graphEdge(m_parentEdge[n])); }
+        }
+        std::reverse(result.path.begin(), result.path.end());
+        return result;
+    }
+};
@@ -0,0 +1,847 @@
+#pragma once
+
+#include "MapData.hpp"
+#include "MapCache.hpp"
+#include "WayColumns.hpp"
+#include "Timer.hpp"
+#include "MemoryUsage.hpp"
+#include "FlatIndexMap.hpp"
+#include "RoutingGraph.hpp"
+#include "PerfCounter.hpp"
+#include "AStarSearch.hpp"
+#include "BidirectionalSearch.hpp"
+#include "ContractionHierarchy.hpp"
+#include "Landmarks.hpp"
+#include "HubLabels.hpp"
+#include "CustomizableRoutePlanner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// command line benchmarks of the map loading pipeline, run with: sfmlgame --bench ways.txt
+// several files can be given to compare importers, e.g. --bench ways.txt region.osm.pbf
+// no window is opened, results are printed to the console
+class Benchmark
+{
+public:
+
+    static void run(const std::vector<std::string>& filenames)
+    {
+        reportBlobCompression();
+        for (const std::string& filename : filenames)
+        {
+            MapData map;
+            map.setSpatialOrder(false);
+
+            // the previous map has been freed, so the peak only covers this load where supported
+            bool peakReset = MemoryUsage::resetPeakRSS();
+
+            std::cout << "\n" << filename << "\n";
+            Timer timer;
+            MapCache::parseSource(map, filename);
+            std::cout << "Total load time: " << timer.getElapsedSec() << "s, "
+                      << map.getWays().size() << " ways, " << map.getNodes().size() << " nodes\n";
+            std::cout << "Peak RSS " << (peakReset ? "during load: " : "of the process: ") << MemoryUsage::toMB(MemoryUsage::getPeakRSS()) << " MB\n";
+
+            if (map.getWays().empty()) { continue; }
+
+            reportLoadMemory(map);
+            reportWayMemory(map);
+            reportTagFilters(map);
+            reportNodeDedup(map);
+            reportNodeBuild(map);
+            reportGraph(map);
+            reportIndexWidth(map);
+            reportRoutingGraph(map);
+            reportSpatialOrder(map);
+            reportDirectedGraphs(map);
+            reportSearch(map);
+            reportLandmarks(map);
+            reportContractionHierarchy(map);
+            reportHubLabels(map);
+            reportCustomizableRoutes(map);
+        }
+    }
+
+    // both landmark selections for every travel mode, A* with the landmark bounds against the straight
+    // line and dijkstra on the same queries
+    static void reportLandmarks(MapData& map)
+    {
+        const Graph& graph = map.getGraph();
+        AStarSearch engine;
+        BidirectionalSearch bidirectional;
+        for (size_t m = 0; m < NumTravelModes; m++)
+        {
+            const TravelMode mode = TravelMode(m);
+            const DirectedGraph& directed = map.getDirectedGraph(mode);
+            const std::vector<std::pair<uint32_t, uint32_t>> queries = randomQueries(graph, directed, 100, 42);
+            if (queries.empty()) { continue; }
+            const double numQueries = double(queries.size());
+
+            std::vector<SearchResult> dijkstra;
+            size_t straightLineSettled = 0;
+            for (auto [start, goal] : queries)
+            {
+                dijkstra.push_back(engine.search(graph, directed, start, goal, false));
+                straightLineSettled += engine.search(graph, directed, start, goal).settled;
+            }
+            std::cout << "Landmarks " << getTravelModeName(mode) << ": straight line A* " << straightLineSettled / numQueries << " settled\n";
+
+            for (Landmarks::Selection selection : { Landmarks::Selection::Farthest, Landmarks::Selection::Avoid })
+            {
+                Timer timer;
+                map.buildLandmarks(mode, Landmarks::DefaultCount, selection);
+                const double buildSec = timer.getElapsedSec();
+                Landmarks& landmarks = map.getLandmarks(mode);
+
+                const std::string filename = "benchmark.alt";
+                const uint64_t graphHash = MapCache::hashDirectedGraph(directed);
+                timer.start();
+                bool roundTrip = landmarks.save(filename, graphHash) && landmarks.load(filename, graphHash, graph.numNodes());
+                double ioMillis = timer.getElapsedMillis();
+                std::remove(filename.c_str());
+
+                double millis[2] = { 0, 0 };
+                size_t settled[2] = { 0, 0 };
+                size_t mismatches = 0;
+                for (size_t q = 0; q < queries.size(); q++)
+                {
+                    const auto [start, goal] = queries[q];
+                    const std::vector<uint32_t> active = landmarks.selectActive(start, goal, Landmarks::DefaultActive);
+                    const LandmarkHeuristic toGoal(landmarks, active, goal), fromStart(landmarks, active, start, true);
+                    SearchResult results[2] = { engine.searchWith(graph, directed, start, goal, toGoal),
+                                                bidirectional.searchWith(graph, directed, start, goal, toGoal, fromStart) };
+                    for (size_t a = 0; a < 2; a++)
+                    {
+                        millis[a] += results[a].millis;
+                        settled[a] += results[a].settled;
+                        mismatches += dijkstra[q].found() != results[a].found() || std::abs(dijkstra[q].cost - results[a].cost) > 1e-3 * std::max(1.0, dijkstra[q].cost);
+                    }
+                }
+
+                std::cout << "   " << (selection == Landmarks::Selection::Farthest ? "farthest" : "avoid") << ": built in " << buildSec << "s, save and load "
+                          << ioMillis << "ms" << (roundTrip ? "" : " FAILED") << ", A* " << millis[0] / numQueries << "ms " << settled[0] / numQueries
+                          << " settled, bidirectional A* " << millis[1] / numQueries << "ms " << settled[1] / numQueries << " settled, "
+                          << mismatches << " cost mismatches\n";
+            }
+        }
+    }
+
+    // contracts every travel mode and checks its queries against bidirectional dijkstra
+    static void reportContractionHierarchy(MapData& map)
+    {
+        const Graph& graph = map.getGraph();
+        BidirectionalSearch bidirectional;
+        for (size_t m = 0; m < NumTravelModes; m++)
+        {
+            const TravelMode mode = TravelMode(m);
+            const DirectedGraph& directed = map.getDirectedGraph(mode);
+            map.buildHierarchy(mode);
+            ContractionHierarchy& hierarchy = map.getHierarchy(mode);
+
+            // the saved hierarchy has to load back identically, and much faster than it was built
+            const std::string filename = "benchmark.ch";
+            const uint64_t graphHash = MapCache::hashDirectedGraph(directed);
+            Timer timer;
+            bool roundTrip = hierarchy.save(filename, graphHash) && hierarchy.load(filename, graphHash, graph.numNodes(), graph.numEdges());
+            double ioMillis = timer.getElapsedMillis();
+            std::remove(filename.c_str());
+
+            double millis[2] = { 0, 0 };
+            size_t settled[2] = { 0, 0 };
+            size_t mismatches = 0;
+            const std::vector<std::pair<uint32_t, uint32_t>> queries = randomQueries(graph, directed, 100, 42);
+            for (auto [start, goal] : queries)
+            {
+                SearchResult results[2] = { bidirectional.search(graph, directed, start, goal, false), hierarchy.search(graph, start, goal) };
+                for (size_t a = 0; a < 2; a++)
+                {
+                    millis[a] += results[a].millis;
+                    settled[a] += results[a].settled;
+                }
+                mismatches += results[0].found() != results[1].found() || std::abs(results[0].cost - results[1].cost) > 1e-3 * std::max(1.0, results[0].cost);
+            }
+
+            const double numQueries = double(std::max<size_t>(1, queries.size()));
+            std::cout << "Hierarchy " << getTravelModeName(mode) << ": " << hierarchy.numShortcuts() << " shortcuts for " << directed.numEdges()
+                      << " edges, save and load " << ioMillis << "ms" << (roundTrip ? "" : " FAILED") << ", " << queries.size() << " queries "
+                      << millis[1] / numQueries << "ms " << settled[1] / numQueries << " settled, bidirectional dijkstra "
+                      << millis[0] / numQueries << "ms " << settled[0] / numQueries << " settled, " << mismatches << " cost mismatches\n";
+        }
+    }
+
+    // builds a .osm.pbf blob of each compression the build supports around the same block bytes and
+    // decodes it again, so a wrong field number or a broken decompressor shows up without a test file
+    static void reportBlobCompression()
+    {
+        std::string block;
+        for (int i = 0; i < 4096; i++) { block += "highway=residential " + std::to_string(i % 97) + "\n"; }
+
+        auto varint = [](std::string& out, uint64_t value)
+        {
+            for (; value >= 0x80; value >>= 7) { out += char(uint8_t(value) | 0x80); }
+            out += char(value);
+        };
+        auto blob = [&](uint32_t field, const std::string& data)
+        {
+            std::string out;
+            varint(out, (2 << 3) | 0);
+            varint(out, block.size());
+            varint(out, (field << 3) | 2);
+            varint(out, data.size());
+            return out + data;
+        };
+        auto check = [&](const char* name, const std::string& message)
+        {
+            std::vector<char> storage;
+            bool ok = false;
+            try { ok = OSMPBFReader::decompressBlob(message, storage) == block; }
+            catch (const std::exception& e) { std::cout << "Blob " << name << ": " << e.what() << "\n"; }
+            std::cout << "Blob " << name << ": " << (ok ? "decoded" : "FAILED") << "\n";
+        };
+
+        check("raw", blob(1, block));
+#ifdef NLMAP_WITH_ZLIB
+        std::string zlibData(compressBound(uLong(block.size())), 0);
+        uLongf zlibSize = uLongf(zlibData.size());
+        compress(reinterpret_cast<Bytef*>(zlibData.data()), &zlibSize, reinterpret_cast<const Bytef*>(block.data()), uLong(block.size()));
+        zlibData.resize(zlibSize);
+        check("zlib", blob(3, zlibData));
+#endif
+#ifdef NLMAP_WITH_ZSTD
+        std::string zstdData(ZSTD_compressBound(block.size()), 0);
+        const size_t zstdSize = ZSTD_compress(zstdData.data(), zstdData.size(), block.data(), block.size(), 3);
+        zstdData.resize(ZSTD_isError(zstdSize) ? 0 : zstdSize);
+        check("zstd", blob(7, zstdData));
+#endif
+    }
+
+    // labels every travel mode from the hierarchies reportContractionHierarchy() left behind, through
+    // MapCache::loadHubLabels() as a batch tool would: the first call builds, saves and maps the label
+    // files, the second only maps them. then checks the distances against the hierarchy queries and
+    // times both. a label query is too short to time on its own, so they are timed together
+    static void reportHubLabels(MapData& map)
+    {
+        const Graph& graph = map.getGraph();
+        if (graph.numNodes() == 0) { return; }
+
+        const std::string filename = "benchmark";
+        Timer timer;
+        MapCache::loadHubLabels(map, filename);
+        const double buildSec = timer.getElapsedSec();
+        for (size_t m = 0; m < NumTravelModes; m++) { map.getHubLabels(TravelMode(m)).clear(); }
+        timer.start();
+        MapCache::loadHubLabels(map, filename);
+        std::cout << "Hub labels: built, saved and mapped in " << buildSec << "s, mapped again in " << timer.getElapsedMillis() << "ms\n";
+
+        for (size_t m = 0; m < NumTravelModes; m++)
+        {
+            const TravelMode mode = TravelMode(m);
+            const DirectedGraph& directed = map.getDirectedGraph(mode);
+            ContractionHierarchy& hierarchy = map.getHierarchy(mode);
+            HubLabels& labels = map.getHubLabels(mode);
+            if (hierarchy.empty() || labels.empty()) { continue; }
+
+            std::mt19937 rng(42);
+            std::uniform_int_distribution<uint32_t> node(0, uint32_t(graph.numNodes() - 1));
+            std::vector<std::pair<uint32_t, uint32_t>> pairs(100000);
+            for (auto& [start, goal] : pairs) { start = node(rng); goal = node(rng); }
+
+            // 100 queries with a path, then random pairs, most of which have none on fragmented maps
+            double hierarchyMillis = 0;
+            size_t mismatches = 0;
+            std::vector<std::pair<uint32_t, uint32_t>> queries = randomQueries(graph, directed, 100, 42);
+            queries.insert(queries.end(), pairs.begin(), pairs.begin() + 900);
+            for (auto [start, goal] : queries)
+            {
+                const SearchResult result = hierarchy.search(graph, start, goal);
+                const double distance = labels.distance(start, goal);
+                hierarchyMillis += result.millis;
+                mismatches += result.found() != std::isfinite(distance) || (result.found() && std::abs(result.cost - distance) > 1e-3 * std::max(1.0, result.cost));
+            }
+
+            size_t reachable = 0;
+            timer.start();
+            for (auto [start, goal] : pairs) { reachable += std::isfinite(labels.distance(start, goal)); }
+            const double micros = timer.getElapsedMillis() * 1000.0 / double(pairs.size());
+
+            std::cout << "Hub labels " << getTravelModeName(mode) << ": " << labels.averageLabelSize() << " hubs per label, "
+                      << labels.getLabelBytes() / (1024.0 * 1024.0) << " MB" << (labels.isMapped() ? " mapped" : " NOT MAPPED") << ", "
+                      << micros << "us per distance (" << reachable << " of " << pairs.size() << " reachable), " << queries.size()
+                      << " queries checked, hierarchy " << hierarchyMillis / double(std::max<size_t>(1, queries.size())) << "ms, "
+                      << mismatches << " cost mismatches\n";
+
+            // the mapping has to go before the file can be removed everywhere
+            labels.clear();
+            std::remove((filename + "." + getTravelModeName(mode) + ".hl").c_str());
+        }
+    }
+
+    // overlay queries against bidirectional dijkstra for every travel mode, then again after the car
+    // speeds changed, which only customizes the overlays again. comes last, since it drops the
+    // hierarchies and landmarks
+    static void reportCustomizableRoutes(MapData& map)
+    {
+        const Graph& graph = map.getGraph();
+        BidirectionalSearch bidirectional;
+        auto compare = [&](const char* label)
+        {
+            for (size_t m = 0; m < NumTravelModes; m++)
+            {
+                const TravelMode mode = TravelMode(m);
+                const DirectedGraph& directed = map.getDirectedGraph(mode);
+                CustomizableRoutePlanner& planner = map.getRoutePlanner(mode);
+
+                double millis[2] = { 0, 0 };
+                size_t settled[2] = { 0, 0 };
+                size_t mismatches = 0;
+                const std::vector<std::pair<uint32_t, uint32_t>> queries = randomQueries(graph, directed, 100, 42);
+                for (auto [start, goal] : queries)
+                {
+                    SearchResult results[2] = { bidirectional.search(graph, directed, start, goal, false), planner.search(graph, directed, start, goal) };
+                    for (size_t a = 0; a < 2; a++)
+                    {
+                        millis[a] += results[a].millis;
+                        settled[a] += results[a].settled;
+                    }
+                    mismatches += results[0].found() != results[1].found() || std::abs(results[0].cost - results[1].cost) > 1e-3 * std::max(1.0, results[0].cost);
+                }
+
+                const double numQueries = double(std::max<size_t>(1, queries.size()));
+                std::cout << "Overlay " << getTravelModeName(mode) << " " << label << ": " << queries.size() << " queries " << millis[1] / numQueries << "ms "
+                          << settled[1] / numQueries << " settled, bidirectional dijkstra " << millis[0] / numQueries << "ms "
+                          << settled[0] / numQueries << " settled, " << mismatches << " cost mismatches\n";
+            }
+        };
+
+        map.buildRoutePlanners();
+        compare("default speeds");
+
+        SpeedTable& speeds = map.getSpeedTable();
+        speeds.setHighwaySpeed("motorway", 80);
+        speeds.setHighwaySpeed("residential", 15);
+        Timer timer;
+        map.updateSpeeds();
+        std::cout << "Speed change applied in " << timer.getElapsedMillis() << "ms\n";
+        compare("slower motorways and residential");
+    }
+
+    // random queries for a travel mode, starting only at nodes the mode can use, since most nodes of
+    // a map are on buildings and areas. each goal is drawn from the nodes its start reaches, so
+    // every query has a path to find
+    static std::vector<std::pair<uint32_t, uint32_t>> randomQueries(const Graph& graph, const DirectedGraph& directed, size_t count, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        std::vector<uint32_t> usable;
+        for (uint32_t n = 0; n < graph.numNodes(); n++)
+        {
+            if (directed.forward().beginEdge(n) < directed.forward().endEdge(n)) { usable.push_back(n); }
+        }
+
+        std::vector<std::pair<uint32_t, uint32_t>> queries;
+        if (usable.empty()) { return queries; }
+
+        std::uniform_int_distribution<size_t> randomNode(0, usable.size() - 1);
+        for (size_t q = 0; q < count; q++)
+        {
+            const uint32_t start = usable[randomNode(rng)];
+            std::vector<double> dist = dijkstra(graph.numNodes(), start, [&](uint32_t n, auto relax)
+            {
+                for (uint32_t e = directed.forward().beginEdge(n); e < directed.forward().endEdge(n); e++) { relax(directed.forward().target(e), directed.forward().weight(e)); }
+            });
+            std::vector<uint32_t> reached;
+            for (uint32_t n = 0; n < dist.size(); n++) { if (!std::isinf(dist[n])) { reached.push_back(n); } }
+            queries.push_back({ start, reached[std::uniform_int_distribution<size_t>(0, reached.size() - 1)(rng)] });
+        }
+        return queries;
+    }
+
+    // point to point queries from random nodes for every travel mode, dijkstra and A* from one end
+    // and from both, which must all find paths of the same cost
+    static void reportSearch(MapData& map)
+    {
+        const Graph& graph = map.getGraph();
+
+        AStarSearch engine;
+        BidirectionalSearch bidirectional;
+        const char* names[4] = { "dijkstra", "A*", "bidirectional dijkstra", "bidirectional A*" };
+        for (size_t m = 0; m < NumTravelModes; m++)
+        {
+            const DirectedGraph& directed = map.getDirectedGraph(TravelMode(m));
+            const std::vector<std::pair<uint32_t, uint32_t>> queries = randomQueries(graph, directed, 100, 42);
+            if (queries.empty()) { continue; }
+            const size_t numQueries = queries.size();
+
+            double millis[4] = { 0, 0, 0, 0 };
+            size_t settled[4] = { 0, 0, 0, 0 }, settledBackward[4] = { 0, 0, 0, 0 };
+            size_t found = 0, mismatches = 0;
+            for (auto [start, goal] : queries)
+            {
+                SearchResult results[4] =
+                {
+                    engine.search(graph, directed, start, goal, false),
+                    engine.search(graph, directed, start, goal, true),
+                    bidirectional.search(graph, directed, start, goal, false),
+                    bidirectional.search(graph, directed, start, goal, true),
+                };
+                for (size_t a = 0; a < 4; a++)
+                {
+                    millis[a] += results[a].millis;
+                    settled[a] += results[a].settled;
+                    settledBackward[a] += results[a].settledBackward;
+                    mismatches += results[a].found() != results[0].found() || std::abs(results[a].cost - results[0].cost) > 1e-3 * std::max(1.0, results[0].cost);
+                }
+                found += results[0].found();
+            }
+
+            std::cout << "Search " << getTravelModeName(TravelMode(m)) << ": " << found << " of " << numQueries << " paths found, " << mismatches << " cost mismatches\n";
+            for (size_t a = 0; a < 4; a++)
+            {
+                std::cout << "  " << names[a] << ": " << millis[a] / numQueries << "ms, " << settled[a] / numQueries << " settled";
+                if (settledBackward[a] > 0) { std::cout << " (" << settledBackward[a] / numQueries << " backward)"; }
+                std::cout << "\n";
+            }
+        }
+        std::cout << "Search engine memory: " << engine.getMemoryBytes() / (1024.0 * 1024.0) << " MB one way, "
+                  << bidirectional.getMemoryBytes() / (1024.0 * 1024.0) << " MB bidirectional\n";
+    }
+
+    // searches the legal edges of every travel mode from the same starts as the undirected graph
+    static void reportDirectedGraphs(MapData& map)
+    {
+        Timer profileTimer;
+        map.buildProfiles();
+        double profileMillis = profileTimer.getElapsedMillis();
+
+        size_t profileBytes = 0;
+        for (size_t m = 0; m < NumTravelModes; m++) { profileBytes += map.getDirectedGraph(TravelMode(m)).getMemoryBytes(); }
+        const size_t sharedBytes = map.getGraph().getMemoryBytes() + map.getNodes().size() * sizeof(Node);
+        std::cout << "Profiles built in one pass in " << profileMillis << "ms on " << map.getNumThreads() << " threads, shared graph and nodes "
+                  << sharedBytes / (1024.0 * 1024.0) << " MB, all profile edges " << profileBytes / (1024.0 * 1024.0) << " MB\n";
+
+        const Graph& graph = map.getGraph();
+        const size_t numNodes = graph.numNodes();
+        const size_t numQueries = std::min<size_t>(8, numNodes);
+
+        // counts the nodes a full search reaches, which is what pruning illegal edges saves
+        auto search = [&](auto forEachEdge, size_t& reached)
+        {
+            Timer timer;
+            reached = 0;
+            for (size_t q = 0; q < numQueries; q++)
+            {
+                std::vector<double> dist = dijkstra(numNodes, uint32_t(q * numNodes / numQueries), forEachEdge);
+                for (double d : dist) { reached += !std::isinf(d); }
+            }
+            return timer.getElapsedMillis();
+        };
+
+        size_t reached = 0;
+        double millis = search([&](uint32_t n, auto relax)
+        {
+            for (uint32_t e = graph.beginEdge(n); e < graph.endEdge(n); e++) { relax(graph.target(e), graph.travelTime(e)); }
+        }, reached);
+        std::cout << "Undirected: " << graph.numEdges() << " edges, " << numQueries << " searches reach " << reached << " nodes in " << millis << "ms\n";
+
+        for (size_t m = 0; m < NumTravelModes; m++)
+        {
+            const DirectedGraph& directed = map.getDirectedGraph(TravelMode(m));
+            const DirectedGraph::Adjacency& forward = directed.forward();
+            millis = search([&](uint32_t n, auto relax)
+            {
+                for (uint32_t e = forward.beginEdge(n); e < forward.endEdge(n); e++) { relax(forward.target(e), forward.weight(e)); }
+            }, reached);
+            std::cout << "Directed " << getTravelModeName(TravelMode(m)) << ": " << directed.numEdges() << " edges, "
+                      << directed.getMemoryBytes() / (1024.0 * 1024.0) << " MB forward and reverse, " << numQueries
+                      << " searches reach " << reached << " nodes in " << millis << "ms\n";
+        }
+    }
+
+    // a plain dijkstra over any graph given as forEachEdge(node, relax(next, length)), which stops
+    // after maxSettled nodes, only used to compare graph layouts against each other
+    template <class ForEachEdge>
+    static std::vector<double> dijkstra(size_t numNodes, uint32_t start, ForEachEdge forEachEdge, size_t maxSettled = SIZE_MAX)
+    {
+        std::vector<double> dist(numNodes, std::numeric_limits<double>::infinity());
+        std::priority_queue<std::pair<double, uint32_t>, std::vector<std::pair<double, uint32_t>>, std::greater<>> open;
+        dist[start] = 0;
+        open.push({ 0.0, start });
+        for (size_t settled = 0; !open.empty() && settled < maxSettled; )
+        {
+            auto [d, n] = open.top();
+            open.pop();
+            if (d > dist[n]) { continue; }
+            settled++;
+            forEachEdge(n, [&](uint32_t next, double length)
+            {
+                if (d + length < dist[next]) { dist[next] = d + length; open.push({ dist[next], next }); }
+            });
+        }
+        return dist;
+    }
+
+    // runs the same searches on the map in load order and after renumbering it along a hilbert
+    // curve, run() loads the map with the renumbering turned off so there is a before to compare
+    static void reportSpatialOrder(MapData& map)
+    {
+        const Graph& graph = map.getGraph();
+        const size_t numNodes = graph.numNodes();
+        const size_t numFull = std::min<size_t>(4, numNodes), numLocal = std::min<size_t>(256, numNodes);
+
+        // the searches start at the same places on the map, so they are found again by position
+        std::vector<sf::Vector2f> starts;
+        for (size_t q = 0; q < numFull + numLocal; q++) { starts.push_back(graph.position((q * 7919) % numNodes)); }
+
+        auto runSearches = [&](const char* name)
+        {
+            std::vector<uint32_t> startNodes;
+            for (const sf::Vector2f& p : starts)
+            {
+                const std::vector<sf::Vector2f>& positions = graph.getPositions();
+                startNodes.push_back(uint32_t(std::find(positions.begin(), positions.end(), p) - positions.begin()));
+            }
+
+            auto forEachEdge = [&](uint32_t n, auto relax)
+            {
+                for (uint32_t e = graph.beginEdge(n); e < graph.endEdge(n); e++) { relax(graph.target(e), graph.length(e)); }
+            };
+
+            PerfCounter counter;
+            Timer timer;
+            counter.start();
+            for (size_t q = 0; q < numFull; q++) { dijkstra(numNodes, startNodes[q], forEachEdge); }
+            uint64_t fullMisses = counter.stop();
+            double fullMillis = timer.getElapsedMillis();
+
+            timer.start();
+            counter.start();
+            for (size_t q = numFull; q < startNodes.size(); q++) { dijkstra(numNodes, startNodes[q], forEachEdge, 10000); }
+            uint64_t localMisses = counter.stop();
+            double localMillis = timer.getElapsedMillis();
+
+            std::cout << name << ": " << numFull << " full dijkstra searches in " << fullMillis << "ms, "
+                      << numLocal << " searches of 10000 nodes in " << localMillis << "ms";
+            if (counter.isAvailable()) { std::cout << ", cache misses " << fullMisses << " and " << localMisses; }
+            else                       { std::cout << ", cache miss counter not available"; }
+            std::cout << "\n";
+        };
+
+        runSearches("Load order");
+        Timer timer;
+        map.reorderSpatially();
+        double millis = timer.getElapsedMillis();
+        map.buildSearchGraphs();
+        runSearches("Hilbert order");
+        std::cout << "Renumbering " << numNodes << " nodes and " << map.getWays().size() << " ways took " << millis << "ms\n";
+    }
+
+    // builds the junction graph and runs dijkstra from the same few junctions on it and on the full
+    // graph, the distances to every junction have to agree, only the number of settled nodes should differ
+    static void reportRoutingGraph(MapData& map)
+    {
+        const Graph& graph = map.getGraph();
+        Timer buildTimer;
+        RoutingGraph routing;
+        routing.build(graph);
+        const double buildMillis = buildTimer.getElapsedMillis();
+        if (routing.numJunctions() == 0) { return; }
+
+        const size_t numQueries = std::min<size_t>(8, routing.numJunctions());
+        double fullMillis = 0, routingMillis = 0, maxDifference = 0;
+        for (size_t q = 0; q < numQueries; q++)
+        {
+            uint32_t junction = uint32_t(q * routing.numJunctions() / numQueries);
+
+            Timer timer;
+            std::vector<double> full = dijkstra(graph.numNodes(), routing.nodeOf(junction), [&](uint32_t n, auto relax)
+            {
+                for (uint32_t e = graph.beginEdge(n); e < graph.endEdge(n); e++) { relax(graph.target(e), graph.length(e)); }
+            });
+            fullMillis += timer.getElapsedMillis();
+
+            timer.start();
+            std::vector<double> reduced = dijkstra(routing.numJunctions(), junction, [&](uint32_t j, auto relax)
+            {
+                for (uint32_t e = routing.beginEdge(j); e < routing.endEdge(j); e++) { relax(routing.target(e), routing.length(e)); }
+            });
+            routingMillis += timer.getElapsedMillis();
+
+            for (size_t j = 0; j < routing.numJunctions(); j++)
+            {
+                if (std::isinf(full[routing.nodeOf(j)]) != std::isinf(reduced[j])) { maxDifference = std::numeric_limits<double>::infinity(); }
+                else if (!std::isinf(reduced[j])) { maxDifference = std::max(maxDifference, std::abs(full[routing.nodeOf(j)] - reduced[j])); }
+            }
+        }
+
+        std::cout << "Routing graph: " << routing.numJunctions() << " junctions and " << routing.numEdges() << " edges from "
+                  << graph.numNodes() << " nodes and " << graph.numEdges() << " edges, " << routing.getMemoryBytes() / (1024.0 * 1024.0) << " MB, built in "
+                  << buildMillis << "ms\n";
+        std::cout << numQueries << " full dijkstra searches, full graph: " << fullMillis << "ms, routing graph: " << routingMillis
+                  << "ms, largest distance difference " << maxDifference << "\n";
+    }
+
+    // compares the 32 bit csr arrays against a copy with 64 bit offsets and target indices,
+    // which is what the graph would need for more than 4 billion nodes or edges
+    static void reportIndexWidth(MapData& map)
+    {
+        const Graph& graph = map.getGraph();
+        const size_t numNodes = graph.numNodes();
+
+        std::vector<uint64_t> offsets(graph.getOffsets().begin(), graph.getOffsets().end());
+        std::vector<uint64_t> targets(graph.getTargets().begin(), graph.getTargets().end());
+
+        // sums the length of every edge in node order, reading the offsets, targets and target positions
+        auto scan = [&](const auto& offs, const auto& targs)
+        {
+            double length = 0;
+            for (size_t n = 0; n < numNodes; n++)
+            {
+                const sf::Vector2f& p = graph.position(n);
+                for (auto e = offs[n]; e < offs[n + 1]; e++) { length += (graph.position(size_t(targs[e])) - p).length(); }
+            }
+            return length;
+        };
+
+        Timer timer;
+        double length32 = scan(graph.getOffsets(), graph.getTargets());
+        double millis32 = timer.getElapsedMillis();
+
+        timer.start();
+        double length64 = scan(offsets, targets);
+        double millis64 = timer.getElapsedMillis();
+
+        const size_t indexBytes32 = (numNodes + 1 + graph.numEdges()) * sizeof(uint32_t);
+        const size_t indexBytes64 = (numNodes + 1 + graph.numEdges()) * sizeof(uint64_t);
+        std::cout << "Graph indices, 32 bit: " << indexBytes32 / (1024.0 * 1024.0) << " MB, scan in " << millis32 << "ms, 64 bit: "
+                  << indexBytes64 / (1024.0 * 1024.0) << " MB, scan in " << millis64 << "ms" << (length32 == length64 ? "" : ", LENGTHS DIFFER") << "\n";
+
+        // the node array itself, and the optional fixed point copy of the positions
+        map.setFixedPointPositions(true);
+        double maxError = 0;
+        for (size_t n = 0; n < numNodes; n++)
+        {
+            const Graph::FixedPoint& f = graph.fixedPosition(n);
+            maxError = std::max(maxError, std::abs(f.x / Graph::FixedPointScale - graph.position(n).x));
+            maxError = std::max(maxError, std::abs(f.y / Graph::FixedPointScale - graph.position(n).y));
+        }
+        std::cout << "Nodes: " << sizeof(Node) << " bytes each, " << numNodes * sizeof(Node) / (1024.0 * 1024.0) << " MB, fixed point positions "
+                  << numNodes * sizeof(Graph::FixedPoint) / (1024.0 * 1024.0) << " MB, largest rounding difference " << maxError << " degrees\n";
+    }
+
+    // compares the csr graph against per node neighbor vectors, the layout Node used to have:
+    // three std::vectors per node, holding the 64 bit id and the 64 bit index of every neighbor
+    static void reportGraph(MapData& map)
+    {
+        const Graph& graph = map.getGraph();
+        const size_t numNodes = graph.numNodes();
+
+        std::vector<std::vector<uint64_t>> lists(numNodes);
+        for (size_t n = 0; n < numNodes; n++) { lists[n].assign(graph.neighbors(n).begin(), graph.neighbors(n).end()); }
+        size_t vectorBytes = numNodes * 3 * sizeof(std::vector<uint64_t>) + 2 * graph.numEdges() * sizeof(uint64_t);
+
+        // a breadth first traversal of every component, the access pattern of an unweighted search
+        auto traverse = [numNodes](auto neighbors)
+        {
+            std::vector<uint32_t> queue;
+            std::vector<bool> visited(numNodes, false);
+            size_t edges = 0;
+            for (size_t start = 0; start < numNodes; start++)
+            {
+                if (visited[start]) { continue; }
+                visited[start] = true;
+                queue.assign(1, uint32_t(start));
+                for (size_t q = 0; q < queue.size(); q++)
+                {
+                    for (auto next : neighbors(queue[q]))
+                    {
+                        edges++;
+                        if (!visited[next]) { visited[next] = true; queue.push_back(uint32_t(next)); }
+                    }
+                }
+            }
+            return edges;
+        };
+
+        Timer timer;
+        size_t csrEdges = traverse([&](uint32_t n) { return graph.neighbors(n); });
+        double csrMillis = timer.getElapsedMillis();
+
+        timer.start();
+        size_t vectorEdges = traverse([&](uint32_t n) -> const std::vector<uint64_t>& { return lists[n]; });
+        double vectorMillis = timer.getElapsedMillis();
+
+        std::cout << "Graph: " << numNodes << " nodes, " << graph.numEdges() << " edges, csr "
+                  << graph.getMemoryBytes() / (1024.0 * 1024.0) << " MB with lengths, travel times, ways and positions, per node vectors "
+                  << vectorBytes / (1024.0 * 1024.0) << " MB without\n";
+        std::cout << "Traverse all edges, csr: " << csrEdges << " edges in " << csrMillis << "ms, per node vectors: "
+                  << vectorEdges << " edges in " << vectorMillis << "ms\n";
+    }
+
+    // rebuilds the node data with the parallel sort and with the hash table
+    // the hash table goes last, so the map is left numbered the way a normal load numbers it
+    static void reportNodeBuild(MapData& map)
+    {
+        for (MapData::NodeDedup dedup : { MapData::NodeDedup::Sort, MapData::NodeDedup::Hash })
+        {
+            map.setNodeDedup(dedup);
+            Timer timer;
+            map.buildNodeData();
+            std::cout << "Node data built with " << (dedup == MapData::NodeDedup::Sort ? "parallel sort" : "hash table") << " on "
+                      << map.getNumThreads() << " threads in " << timer.getElapsedMillis() << "ms\n";
+        }
+        map.setNodeDedup(MapData::NodeDedup::Auto);
+    }
+
+    // deduplicates the way vertex ids of the map, and a synthetic input of the same size,
+    // with the flat hash table used by NodeData against a std::unordered_map
+    static void reportNodeDedup(MapData& map)
+    {
+        std::vector<uint64_t> ids;
+        for (const Way& way : map.getWays())
+        {
+            for (const Node& n : way.nodes) { ids.push_back(n.id()); }
+        }
+
+        // the synthetic ids are random points on a grid, so about as many repeats as a road network
+        std::vector<uint64_t> synthetic(ids.size());
+        std::mt19937_64 rng(12345);
+        std::uniform_int_distribution<uint32_t> cell(0, uint32_t(std::max<size_t>(1, ids.size() / 2)));
+        for (uint64_t& id : synthetic)
+        {
+            uint32_t c = cell(rng);
+            id = Node::pack_floats(-123.0f + float(c % 4096) * 1e-4f, -49.0f - float(c / 4096) * 1e-4f);
+        }
+
+        timeNodeDedup("map", ids);
+        timeNodeDedup("synthetic", synthetic);
+    }
+
+    static void timeNodeDedup(const char* name, const std::vector<uint64_t>& ids)
+    {
+        // each table is freed before the other one is timed, so neither pays for the other's memory
+        double stdMillis = 0, flatMillis = 0;
+        size_t unique = 0, flatBytes = 0;
+        {
+            Timer timer;
+            std::unordered_map<uint64_t, uint32_t> stdMap;
+            stdMap.reserve(ids.size());
+            for (uint64_t id : ids) { stdMap.try_emplace(id, uint32_t(stdMap.size())); }
+            stdMillis = timer.getElapsedMillis();
+        }
+        {
+            Timer timer;
+            FlatIndexMap flatMap(ids.size());
+            for (uint64_t id : ids) { flatMap.insert(id); }
+            flatMillis = timer.getElapsedMillis();
+            unique = flatMap.size();
+            flatBytes = flatMap.getMemoryBytes();
+        }
+
+        double n = double(std::max<size_t>(1, ids.size()));
+        std::cout << "Node dedup (" << name << ", " << ids.size() << " vertices, " << unique << " unique), std::unordered_map: "
+                  << stdMillis << "ms (" << stdMillis * 1e6 / n << " ns/vertex), flat table: "
+                  << flatMillis << "ms (" << flatMillis * 1e6 / n << " ns/vertex, " << flatBytes / (1024.0 * 1024.0) << " MB)\n";
+    }
+
+    // times the query "residential ways that are lit and not oneway" over the tag columns,
+    // against the same query answered by looking at every Way record
+    static void reportTagFilters(MapData& map)
+    {
+        const std::vector<Way>& ways = map.getWays();
+        const WayTagDictionary& tags = map.getWayData().getTags();
+
+        Timer timer;
+        WayColumns columns;
+        columns.build(ways);
+        double buildMillis = timer.getElapsedMillis();
+
+        timer.start();
+        WayBitset matches = columns.equals(WayTag::Highway, "residential", tags)
+                          & columns.equals(WayTag::Lit, "yes", tags)
+                          & ~columns.equals(WayTag::OneWay, "yes", tags);
+        double columnMillis = timer.getElapsedMillis();
+
+        timer.start();
+        size_t recordMatches = 0;
+        for (const Way& way : ways)
+        {
+            recordMatches += map.getTag(way, WayTag::Highway) == "residential"
+                          && map.getTag(way, WayTag::Lit) == "yes"
+                          && map.getTag(way, WayTag::OneWay) != "yes";
+        }
+        double recordMillis = timer.getElapsedMillis();
+
+        std::cout << "Tag columns: " << columns.getMemoryBytes() / (1024.0 * 1024.0) << " MB, built in " << buildMillis << "ms\n";
+        std::cout << "Filter residential & lit & !oneway, columns: " << matches.count() << " ways in " << columnMillis << "ms\n";
+        std::cout << "Filter residential & lit & !oneway, records: " << recordMatches << " ways in " << recordMillis << "ms\n";
+    }
+
+    // compares the memory used per way by the tags against the old layout,
+    // which stored every csv column as a std::string inside the way
+    // the bytes per way and node of the loaded records, held once, against the loader that copied
+    // every way and node into a hash map first and into its vector after, which held them twice
+    // plus a hash map entry each at its peak. compare with the measured peak RSS of the load above
+    static void reportLoadMemory(MapData& map)
+    {
+        const std::vector<Way>& ways = map.getWays();
+        const std::vector<Node>& nodes = map.getNodes();
+
+        size_t wayBytes = 0;
+        for (const Way& way : ways) { wayBytes += sizeof(Way) + way.nodes.capacity() * sizeof(Node); }
+        const size_t nodeBytes = nodes.size() * sizeof(Node);
+
+        // an unordered_map entry adds its 64 bit key, the list pointer, the allocation header and a bucket
+        const size_t entryBytes = sizeof(uint64_t) + 3 * sizeof(void*);
+        const size_t legacyWayBytes = 2 * wayBytes + ways.size() * entryBytes;
+        const size_t legacyNodeBytes = 2 * nodeBytes + nodes.size() * entryBytes;
+
+        const double numWays = double(std::max<size_t>(1, ways.size()));
+        const double numNodes = double(std::max<size_t>(1, nodes.size()));
+        std::cout << "Load bytes per way, copied into maps: " << double(legacyWayBytes) / numWays << ", built once: " << double(wayBytes) / numWays << "\n";
+        std::cout << "Load bytes per node, copied into maps: " << double(legacyNodeBytes) / numNodes << ", built once: " << double(nodeBytes) / numNodes << "\n";
+        std::cout << "Load records, copied into maps: " << MemoryUsage::toMB(legacyWayBytes + legacyNodeBytes) << " MB, built once: "
+                  << MemoryUsage::toMB(wayBytes + nodeBytes) << " MB\n";
+    }
+
+    static void reportWayMemory(MapData& map)
+    {
+        const std::vector<Way>& ways = map.getWays();
+        const WayTagDictionary& tags = map.getWayData().getTags();
+        const size_t ssoCapacity = std::string().capacity();
+
+        // a string longer than the small string buffer also owns a heap allocation
+        auto stringBytes = [&](size_t length)
+        {
+            return sizeof(std::string) + (length > ssoCapacity ? length + 1 : 0);
+        };
+
+        size_t stringTagBytes = 0;
+        for (const Way& way : ways)
+        {
+            // the old way also kept its id and node count columns as strings
+            stringTagBytes += stringBytes(std::to_string(way.id).size());
+            stringTagBytes += stringBytes(std::to_string(way.count).size());
+            for (size_t f = 0; f < WayTag::Count; f++)
+            {
+                stringTagBytes += stringBytes(tags.decode(WayTag::Field(f), way.tags[f]).size());
+            }
+        }
+
+        size_t codeTagBytes = ways.size() * sizeof(Way::tags) + tags.getMemoryBytes();
+        double numWays = double(ways.size());
+
+        std::cout << "Tag bytes per way, std::string fields: " << double(stringTagBytes) / numWays << "\n";
+        std::cout << "Tag bytes per way, dictionary codes:   " << double(codeTagBytes) / numWays
+                  << " (" << sizeof(Way::tags) << " bytes of codes + shared dictionaries)\n";
+    }
+};
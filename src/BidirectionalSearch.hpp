@@ -0,0 +1,172 @@
+#pragma once
+
+#include "AStarSearch.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// point to point search from both ends at once, forward from the start over the forward edges and
+// backward from the goal over the reverse edges, taking turns one settled node at a time
+//
+// every edge relaxed into a node the other side has reached is a complete path, the shortest
+// seen so far is kept as mu. once the smallest keys of the two open lists add up to mu, no
+// path through an unsettled node can be shorter and the search stops
+//
+// with potentials both sides use the average of two heuristics, straight line or landmark bounds:
+// half of the bound to the goal minus half of the bound from the start, forward and negated backward. the
+// edge costs reduced by this potential are the same in both directions, so the stopping rule
+// above stays correct, while each side still searches towards the other end
+class BidirectionalSearch
+{
+    static constexpr uint32_t None = UINT32_MAX;
+
+    struct Side
+    {
+        const DirectedGraph::Adjacency* edges = nullptr;
+        std::vector<float>      dist;
+        std::vector<uint32_t>   parent;
+        std::vector<uint32_t>   parentEdge;     // the edge of this side's adjacency a node was reached by
+        std::vector<uint32_t>   stamp;
+        BinaryHeap              open;
+        size_t                  settled = 0;
+    };
+
+    Side        m_sides[2];                     // forward from the start, backward from the goal
+    uint32_t    m_currentStamp = 0;
+
+public:
+
+    SearchResult search(const Graph& graph, const DirectedGraph& directed, uint32_t start, uint32_t goal, bool usePotentials = true)
+    {
+        auto none = [](uint32_t) { return 0.0f; };
+        if (!usePotentials) { return searchWith(graph, directed, start, goal, none, none); }
+
+        const StraightLineHeuristic toGoal(graph, directed, graph.position(goal));
+        const StraightLineHeuristic fromStart(graph, directed, graph.position(start));
+        return searchWith(graph, directed, start, goal, [&](uint32_t n) { return toGoal(graph.position(n)); },
+                                                        [&](uint32_t n) { return fromStart(graph.position(n)); });
+    }
+
+    // toGoal(node) and fromStart(node) have to be consistent lower bounds on the travel time from
+    // the node to the goal, and from the start to the node
+    template <class ToGoal, class FromStart>
+    SearchResult searchWith(const Graph& graph, const DirectedGraph& directed, uint32_t start, uint32_t goal, ToGoal toGoal, FromStart fromStart)
+    {
+        Timer timer;
+        startQuery(graph.numNodes());
+        m_sides[0].edges = &directed.forward();
+        m_sides[1].edges = &directed.reverse();
+
+        auto potential = [&](int side, uint32_t n)
+        {
+            const float forward = 0.5f * (toGoal(n) - fromStart(n));
+            return side == 0 ? forward : -forward;
+        };
+
+        float mu = std::numeric_limits<float>::infinity();
+        uint32_t meet = None;
+        auto reach = [&](int side, uint32_t n, float d, uint32_t parent, uint32_t parentEdge)
+        {
+            Side& s = m_sides[side];
+            s.stamp[n] = m_currentStamp;
+            s.dist[n] = d;
+            s.parent[n] = parent;
+            s.parentEdge[n] = parentEdge;
+            s.open.push(n, d + potential(side, n));
+
+            const Side& other = m_sides[1 - side];
+            if (other.stamp[n] == m_currentStamp && d + other.dist[n] < mu)
+            {
+                mu = d + other.dist[n];
+                meet = n;
+            }
+        };
+
+        reach(0, start, 0.0f, None, None);
+        reach(1, goal, 0.0f, None, None);
+        for (int side = 0; !m_sides[0].open.empty() && !m_sides[1].open.empty(); side = 1 - side)
+        {
+            if (m_sides[0].open.minKey() + m_sides[1].open.minKey() >= mu) { break; }
+
+            Side& s = m_sides[side];
+            const uint32_t n = s.open.pop();
+            s.settled++;
+
+            const float g = s.dist[n];
+            for (uint32_t e = s.edges->beginEdge(n); e < s.edges->endEdge(n); e++)
+            {
+                const uint32_t t = s.edges->target(e);
+                const float d = g + s.edges->weight(e);
+                if (s.stamp[t] == m_currentStamp && d >= s.dist[t]) { continue; }
+                reach(side, t, d, n, e);
+            }
+        }
+
+        SearchResult result;
+        if (meet != None) { result = tracePath(graph, meet, mu); }
+        result.settled = m_sides[0].settled + m_sides[1].settled;
+        result.settledBackward = m_sides[1].settled;
+        for (Side& s : m_sides) { s.open.clear(); }
+        result.millis = timer.getElapsedMillis();
+        return result;
+    }
+
+    size_t getMemoryBytes() const
+    {
+        size_t bytes = 0;
+        for (const Side& s : m_sides)
+        {
+            bytes += s.dist.capacity() * sizeof(float) + (s.parent.capacity() + s.parentEdge.capacity() + s.stamp.capacity()) * sizeof(uint32_t)
+                   + s.open.getMemoryBytes();
+        }
+        return bytes;
+    }
+
+private:
+
+    // the same timestamp marks the valid state of both sides, see AStarSearch
+    void startQuery(size_t numNodes)
+    {
+        for (Side& s : m_sides)
+        {
+            s.settled = 0;
+            if (s.stamp.size() == numNodes) { continue; }
+
+            s.dist.assign(numNodes, 0.0f);
+            s.parent.assign(numNodes, None);
+            s.parentEdge.assign(numNodes, None);
+            s.stamp.assign(numNodes, 0);
+            s.open.resize(numNodes);
+            m_currentStamp = 0;
+        }
+
+        if (++m_currentStamp == 0)
+        {
+            for (Side& s : m_sides) { std::fill(s.stamp.begin(), s.stamp.end(), 0); }
+            m_currentStamp = 1;
+        }
+    }
+
+    // the forward parents lead from the meeting node back to the start, the backward parents on to the goal
+    SearchResult tracePath(const Graph& graph, uint32_t meet, float cost) const
+    {
+        SearchResult result;
+        result.cost = cost;
+
+        for (uint32_t n = meet; n != None; n = m_sides[0].parent[n])
+        {
+            result.path.push_back(n);
+            if (m_sides[0].parentEdge[n] != None) { result.length += graph.length(m_sides[0].edges->graphEdge(m_sides[0].parentEdge[n])); }
+        }
+        std::reverse(result.path.begin(), result.path.end());
+
+        for (uint32_t n = meet; m_sides[1].parent[n] != None; n = m_sides[1].parent[n])
+        {
+            result.length += graph.length(m_sides[1].edges->graphEdge(m_sides[1].parentEdge[n]));
+            result.path.push_back(m_sides[1].parent[n]);
+        }
+        return result;
+    }
+};
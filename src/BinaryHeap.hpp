@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// a binary min heap of node indices keyed by float, with decrease key, used as the open list of searches
+//
+// the position of every node in the heap is kept in an array over all nodes, so a node is never
+// in the heap twice and there are no stale entries to skip. clear() only touches the nodes still
+// in the heap, so starting a new search does not cost time proportional to the size of the graph
+class BinaryHeap
+{
+    struct Item
+    {
+        float       key;
+        uint32_t    node;
+    };
+
+    static constexpr uint32_t NotInHeap = UINT32_MAX;
+
+    std::vector<Item>       m_items;
+    std::vector<uint32_t>   m_positions;
+
+public:
+
+    // makes room for node indices below numNodes, must be called before a search on a new graph
+    void resize(size_t numNodes)
+    {
+        clear();
+        m_positions.assign(numNodes, NotInHeap);
+    }
+
+    void clear()
+    {
+        for (const Item& item : m_items) { m_positions[item.node] = NotInHeap; }
+        m_items.clear();
+    }
+
+    bool empty() const
+    {
+        return m_items.empty();
+    }
+
+    size_t size() const
+    {
+        return m_items.size();
+    }
+
+    bool contains(uint32_t node) const
+    {
+        return m_positions[node] != NotInHeap;
+    }
+
+    float minKey() const
+    {
+        return m_items[0].key;
+    }
+
+    // inserts the node, or lowers its key if it is already in the heap with a larger one
+    void push(uint32_t node, float key)
+    {
+        uint32_t position = m_positions[node];
+        if (position == NotInHeap)
+        {
+            position = uint32_t(m_items.size());
+            m_items.push_back({ key, node });
+        }
+        else if (key < m_items[position].key)
+        {
+            m_items[position].key = key;
+        }
+        else
+        {
+            return;
+        }
+        siftUp(position);
+    }
+
+    uint32_t pop()
+    {
+        const uint32_t node = m_items[0].node;
+        m_positions[node] = NotInHeap;
+
+        const Item last = m_items.back();
+        m_items.pop_back();
+        if (!m_items.empty())
+        {
+            m_items[0] = last;
+            m_positions[last.node] = 0;
+            siftDown(0);
+        }
+        return node;
+    }
+
+    size_t getMemoryBytes() const
+    {
+        return m_items.capacity() * sizeof(Item) + m_positions.capacity() * sizeof(uint32_t);
+    }
+
+private:
+
+    void siftUp(uint32_t position)
+    {
+        const Item item = m_items[position];
+        while (position > 0)
+        {
+            const uint32_t parent = (position - 1) / 2;
+            if (m_items[parent].key <= item.key) { break; }
+
+            m_items[position] = m_items[parent];
+            m_positions[m_items[position].node] = position;
+            position = parent;
+        }
+        m_items[position] = item;
+        m_positions[item.node] = position;
+    }
+
+    void siftDown(uint32_t position)
+    {
+        const Item item = m_items[position];
+        const uint32_t size = uint32_t(m_items.size());
+        while (true)
+        {
+            uint32_t child = 2 * position + 1;
+            if (child >= size) { break; }
+            if (child + 1 < size && m_items[child + 1].key < m_items[child].key) { child++; }
+            if (item.key <= m_items[child].key) { break; }
+
+            m_items[position] = m_items[child];
+            m_positions[m_items[position].node] = position;
+            position = child;
+        }
+        m_items[position] = item;
+        m_positions[item.node] = position;
+    }
+};
@@ -0,0 +1,665 @@
+#pragma once
+
+#include "DirectedGraph.hpp"
+#include "AStarSearch.hpp"
+#include "BinaryHeap.hpp"
+#include "MappedFile.hpp"
+#include "ParallelFor.hpp"
+#include "Timer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+// contraction hierarchy over the directed graph of one travel mode
+//
+// nodes are contracted one at a time in order of importance. contracting a node removes it from
+// the graph and adds a shortcut between each pair of its neighbors whose shortest path went
+// through it, unless a witness search finds another path no longer than the shortcut. the rank of
+// a node is its position in that order. every shortest path then goes up in rank and comes back
+// down, so a query searches only upward edges from the start and upward reverse edges from the
+// goal, which settles a few hundred nodes instead of most of the map
+//
+// nodes are picked by edge difference (shortcuts added minus edges removed) plus the number of
+// neighbors already contracted, which spreads the contraction evenly over the map. each round
+// contracts a set of nodes no two of which are neighbors, so their witness searches run in parallel
+class ContractionHierarchy
+{
+public:
+
+    static constexpr uint32_t None = UINT32_MAX;
+
+    // an edge of the hierarchy, either a directed graph edge or a shortcut over two other edges
+    struct Edge
+    {
+        uint32_t    target;
+        float       weight;
+        uint32_t    first;      // the graph edge of an original edge, the edge to the contracted node of a shortcut
+        uint32_t    second;     // None for an original edge, the edge from the contracted node of a shortcut
+    };
+
+    // an edge as seen from the lower ranked of its two nodes
+    struct Arc
+    {
+        uint32_t    node;       // the higher ranked node
+        float       weight;
+        uint32_t    edge;
+    };
+
+private:
+
+    std::vector<uint32_t>   m_ranks;
+    std::vector<Edge>       m_edges;
+    std::vector<uint32_t>   m_upOffsets{ 0 };
+    std::vector<Arc>        m_up;               // edges to higher ranked nodes, by their source
+    std::vector<uint32_t>   m_downOffsets{ 0 };
+    std::vector<Arc>        m_down;             // edges from higher ranked nodes, by their target
+    size_t                  m_numShortcuts = 0;
+
+    // per query state of one search direction, valid where its stamp is current, see AStarSearch
+    struct Side
+    {
+        std::vector<float>      dist;
+        std::vector<uint32_t>   parent;
+        std::vector<uint32_t>   parentEdge;     // the hierarchy edge a node was reached by
+        std::vector<uint32_t>   stamp;
+        BinaryHeap              open;
+        size_t                  settled = 0;
+    };
+
+    Side        m_sides[2];                     // up from the start, up backwards from the goal
+    uint32_t    m_currentStamp = 0;
+
+public:
+
+    static constexpr char     Magic[8] = { 'N', 'L', 'C', 'H', 0, 0, 0, 0 };
+    static constexpr uint32_t Version = 3;
+
+    bool empty() const
+    {
+        return m_ranks.empty();
+    }
+
+    size_t numNodes() const
+    {
+        return m_ranks.size();
+    }
+
+    size_t numEdges() const
+    {
+        return m_edges.size();
+    }
+
+    size_t numShortcuts() const
+    {
+        return m_numShortcuts;
+    }
+
+    uint32_t rank(uint32_t node) const
+    {
+        return m_ranks[node];
+    }
+
+    // the edges from a node to higher ranked nodes, and from higher ranked nodes into it
+    const Arc* beginUp(uint32_t node) const   { return m_up.data() + m_upOffsets[node]; }
+    const Arc* endUp(uint32_t node) const     { return m_up.data() + m_upOffsets[node + 1]; }
+    const Arc* beginDown(uint32_t node) const { return m_down.data() + m_downOffsets[node]; }
+    const Arc* endDown(uint32_t node) const   { return m_down.data() + m_downOffsets[node + 1]; }
+
+    void clear()
+    {
+        *this = ContractionHierarchy();
+    }
+
+    size_t getMemoryBytes() const
+    {
+        return (m_ranks.capacity() + m_upOffsets.capacity() + m_downOffsets.capacity()) * sizeof(uint32_t)
+             + m_edges.capacity() * sizeof(Edge) + (m_up.capacity() + m_down.capacity()) * sizeof(Arc);
+    }
+
+    // stops between contraction rounds once cancel is set, leaving the hierarchy empty
+    void build(const DirectedGraph& directed, size_t numNodes, size_t numThreads, const std::atomic<bool>* cancel = nullptr)
+    {
+        clear();
+        Builder builder(directed, numNodes, numThreads);
+        if (!builder.contract(cancel)) { return; }
+
+        m_ranks = std::move(builder.ranks);
+        m_edges = std::move(builder.edges);
+
+        // the edges each node still had when it was contracted all lead to higher ranked nodes
+        size_t numUp = 0, numDown = 0;
+        for (size_t n = 0; n < numNodes; n++) { numUp += builder.out[n].size(); numDown += builder.in[n].size(); }
+        m_up.reserve(numUp);
+        m_down.reserve(numDown);
+        m_upOffsets.reserve(numNodes + 1);
+        m_downOffsets.reserve(numNodes + 1);
+        for (size_t n = 0; n < numNodes; n++)
+        {
+            for (const Builder::WorkEdge& e : builder.out[n]) { m_up.push_back({ e.node, e.weight, e.edge }); }
+            for (const Builder::WorkEdge& e : builder.in[n])  { m_down.push_back({ e.node, e.weight, e.edge }); }
+            m_upOffsets.push_back(uint32_t(m_up.size()));
+            m_downOffsets.push_back(uint32_t(m_down.size()));
+        }
+        countShortcuts();
+    }
+
+    // bidirectional dijkstra over the upward edges, the two sides meet at the highest ranked node
+    // of the shortest path. a node reached more cheaply from a higher ranked node than by its own
+    // parent can't be on a shortest path and is not expanded (stall on demand)
+    SearchResult search(const Graph& graph, uint32_t start, uint32_t goal)
+    {
+        Timer timer;
+        startQuery(numNodes());
+
+        float mu = std::numeric_limits<float>::infinity();
+        uint32_t meet = None;
+        auto reach = [&](int side, uint32_t n, float d, uint32_t parent, uint32_t parentEdge)
+        {
+            Side& s = m_sides[side];
+            s.stamp[n] = m_currentStamp;
+            s.dist[n] = d;
+            s.parent[n] = parent;
+            s.parentEdge[n] = parentEdge;
+            s.open.push(n, d);
+
+            const Side& other = m_sides[1 - side];
+            if (other.stamp[n] == m_currentStamp && d + other.dist[n] < mu)
+            {
+                mu = d + other.dist[n];
+                meet = n;
+            }
+        };
+
+        reach(0, start, 0.0f, None, None);
+        reach(1, goal, 0.0f, None, None);
+        for (int side = 0; ; side = 1 - side)
+        {
+            // a side is done once nothing left on its open list can improve mu
+            const bool active[2] = { !m_sides[0].open.empty() && m_sides[0].open.minKey() < mu,
+                                     !m_sides[1].open.empty() && m_sides[1].open.minKey() < mu };
+            if (!active[0] && !active[1]) { break; }
+            if (!active[side]) { side = 1 - side; }
+
+            Side& s = m_sides[side];
+            const std::vector<uint32_t>& offsets = side == 0 ? m_upOffsets : m_downOffsets;
+            const std::vector<Arc>& arcs = side == 0 ? m_up : m_down;
+            const std::vector<uint32_t>& stallOffsets = side == 0 ? m_downOffsets : m_upOffsets;
+            const std::vector<Arc>& stallArcs = side == 0 ? m_down : m_up;
+
+            const uint32_t n = s.open.pop();
+            s.settled++;
+            const float g = s.dist[n];
+
+            bool stalled = false;
+            for (uint32_t a = stallOffsets[n]; a < stallOffsets[n + 1] && !stalled; a++)
+            {
+                const Arc& arc = stallArcs[a];
+                stalled = s.stamp[arc.node] == m_currentStamp && s.dist[arc.node] + arc.weight < g;
+            }
+            if (stalled) { continue; }
+
+            for (uint32_t a = offsets[n]; a < offsets[n + 1]; a++)
+            {
+                const Arc& arc = arcs[a];
+                const float d = g + arc.weight;
+                if (s.stamp[arc.node] == m_currentStamp && d >= s.dist[arc.node]) { continue; }
+                reach(side, arc.node, d, n, arc.edge);
+            }
+        }
+
+        SearchResult result;
+        if (meet != None) { result = tracePath(graph, start, meet, mu); }
+        result.settled = m_sides[0].settled + m_sides[1].settled;
+        result.settledBackward = m_sides[1].settled;
+        for (Side& s : m_sides) { s.open.clear(); }
+        result.millis = timer.getElapsedMillis();
+        return result;
+    }
+
+    // appends the graph nodes after the source of a hierarchy edge up to its target
+    void unpackEdge(const Graph& graph, uint32_t edge, std::vector<uint32_t>& nodes, double& length) const
+    {
+        std::vector<uint32_t> stack{ edge };
+        while (!stack.empty())
+        {
+            const Edge& e = m_edges[stack.back()];
+            stack.pop_back();
+            if (e.second == None)
+            {
+                nodes.push_back(e.target);
+                length += graph.length(e.first);
+            }
+            else
+            {
+                stack.push_back(e.second);
+                stack.push_back(e.first);
+            }
+        }
+    }
+
+    // the hierarchy is only valid for the exact directed graph it was built from, which is
+    // identified by graphHash, see MapCache::hashDirectedGraph
+    bool save(const std::string& filename, uint64_t graphHash) const
+    {
+        Header header;
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version   = Version;
+        header.graphHash = graphHash;
+        header.numNodes  = m_ranks.size();
+        header.numEdges  = m_edges.size();
+        header.numUp     = m_up.size();
+        header.numDown   = m_down.size();
+
+        return writeFileAtomically(filename, [&](std::ofstream& out)
+        {
+            out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            writeArray(out, m_ranks);
+            writeArray(out, m_edges);
+            writeArray(out, m_upOffsets);
+            writeArray(out, m_up);
+            writeArray(out, m_downOffsets);
+            writeArray(out, m_down);
+        });
+    }
+
+    // returns false if the file is missing, damaged, or was built from a different graph
+    // numGraphEdges is the edge count of the graph the original edges index into
+    bool load(const std::string& filename, uint64_t graphHash, size_t numNodes, size_t numGraphEdges)
+    {
+        MappedFile file(filename);
+        if (!file.isOpen() || file.size() < sizeof(Header)) { return false; }
+
+        Header header;
+        std::memcpy(&header, file.data(), sizeof(Header));
+        if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0) { return false; }
+        if (header.version != Version || header.graphHash != graphHash || header.numNodes != numNodes) { return false; }
+
+        const uint64_t expected = sizeof(Header) + header.numNodes * sizeof(uint32_t) + header.numEdges * sizeof(Edge)
+                                + 2 * (header.numNodes + 1) * sizeof(uint32_t) + (header.numUp + header.numDown) * sizeof(Arc);
+        if (file.size() != expected) { return false; }
+
+        ContractionHierarchy loaded;
+        const char* p = file.data() + sizeof(Header);
+        readArray(p, loaded.m_ranks, header.numNodes);
+        readArray(p, loaded.m_edges, header.numEdges);
+        readArray(p, loaded.m_upOffsets, header.numNodes + 1);
+        readArray(p, loaded.m_up, header.numUp);
+        readArray(p, loaded.m_downOffsets, header.numNodes + 1);
+        readArray(p, loaded.m_down, header.numDown);
+
+        // every index has to be in range before a query follows it
+        for (uint32_t r : loaded.m_ranks) { if (r >= numNodes) { return false; } }
+        // a shortcut only refers to edges before it, so unpacking one always ends at original edges
+        for (size_t i = 0; i < loaded.m_edges.size(); i++)
+        {
+            const Edge& e = loaded.m_edges[i];
+            if (e.target >= numNodes) { return false; }
+            if (e.second == None && e.first >= numGraphEdges) { return false; }
+            if (e.second != None && (e.first >= i || e.second >= i)) { return false; }
+        }
+        for (const auto* offsets : { &loaded.m_upOffsets, &loaded.m_downOffsets })
+        {
+            if (offsets->front() != 0) { return false; }
+            for (size_t n = 0; n < numNodes; n++) { if ((*offsets)[n] > (*offsets)[n + 1]) { return false; } }
+        }
+        if (loaded.m_upOffsets.back() != header.numUp || loaded.m_downOffsets.back() != header.numDown) { return false; }
+        for (const auto* arcs : { &loaded.m_up, &loaded.m_down })
+        {
+            for (const Arc& a : *arcs) { if (a.node >= numNodes || a.edge >= header.numEdges) { return false; } }
+        }
+
+        loaded.countShortcuts();
+        *this = std::move(loaded);
+        return true;
+    }
+
+private:
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t padding = 0;
+        uint64_t graphHash;
+        uint64_t numNodes;
+        uint64_t numEdges;
+        uint64_t numUp;
+        uint64_t numDown;
+    };
+
+    template <class T>
+    static void writeArray(std::ofstream& out, const std::vector<T>& values)
+    {
+        out.write(reinterpret_cast<const char*>(values.data()), std::streamsize(values.size() * sizeof(T)));
+    }
+
+    template <class T>
+    static void readArray(const char*& p, std::vector<T>& values, size_t count)
+    {
+        values.resize(count);
+        std::memcpy(values.data(), p, count * sizeof(T));
+        p += count * sizeof(T);
+    }
+
+    // every edge in use is an arc of exactly one node, edges replaced by cheaper shortcuts are not
+    void countShortcuts()
+    {
+        m_numShortcuts = 0;
+        for (const auto* arcs : { &m_up, &m_down })
+        {
+            for (const Arc& a : *arcs) { m_numShortcuts += m_edges[a.edge].second != None; }
+        }
+    }
+
+    void startQuery(size_t numNodes)
+    {
+        for (Side& s : m_sides)
+        {
+            s.settled = 0;
+            if (s.stamp.size() == numNodes) { continue; }
+
+            s.dist.assign(numNodes, 0.0f);
+            s.parent.assign(numNodes, None);
+            s.parentEdge.assign(numNodes, None);
+            s.stamp.assign(numNodes, 0);
+            s.open.resize(numNodes);
+            m_currentStamp = 0;
+        }
+
+        if (++m_currentStamp == 0)
+        {
+            for (Side& s : m_sides) { std::fill(s.stamp.begin(), s.stamp.end(), 0); }
+            m_currentStamp = 1;
+        }
+    }
+
+    // the upward edges lead from the meeting node back to the start, the downward ones on to the goal
+    SearchResult tracePath(const Graph& graph, uint32_t start, uint32_t meet, float cost) const
+    {
+        SearchResult result;
+        result.cost = cost;
+
+        std::vector<uint32_t> edges;
+        for (uint32_t n = meet; m_sides[0].parent[n] != None; n = m_sides[0].parent[n]) { edges.push_back(m_sides[0].parentEdge[n]); }
+        std::reverse(edges.begin(), edges.end());
+        for (uint32_t n = meet; m_sides[1].parent[n] != None; n = m_sides[1].parent[n]) { edges.push_back(m_sides[1].parentEdge[n]); }
+
+        result.path.push_back(start);
+        for (uint32_t e : edges) { unpackEdge(graph, e, result.path, result.length); }
+        return result;
+    }
+
+    // the working state of the contraction, a graph that loses a node and gains shortcuts every step
+    struct Builder
+    {
+        struct WorkEdge
+        {
+            uint32_t    node;
+            float       weight;
+            uint32_t    edge;
+        };
+
+        struct Shortcut
+        {
+            uint32_t    from;
+            uint32_t    to;
+            float       weight;
+            uint32_t    first;
+            uint32_t    second;
+        };
+
+        // a dijkstra from one neighbor of a node to its other neighbors that avoids the node, it
+        // stops once they are all settled or further than the path through the node. it is also
+        // limited in settled nodes, giving up early only costs a shortcut that wasn't needed
+        struct WitnessSearch
+        {
+            static constexpr size_t MaxSettled = 500;
+
+            std::vector<float>      dist;
+            std::vector<uint32_t>   stamp;
+            std::vector<uint32_t>   targetStamp;    // the nodes the search runs to, it stops once all are settled
+            uint32_t                currentStamp = 0;
+            BinaryHeap              open;
+
+            void run(const Builder& b, uint32_t source, uint32_t avoid, float maxDist)
+            {
+                if (stamp.size() != b.out.size())
+                {
+                    dist.assign(b.out.size(), 0.0f);
+                    stamp.assign(b.out.size(), 0);
+                    targetStamp.assign(b.out.size(), 0);
+                    open.resize(b.out.size());
+                    currentStamp = 0;
+                }
+                if (++currentStamp == 0)
+                {
+                    std::fill(stamp.begin(), stamp.end(), 0);
+                    std::fill(targetStamp.begin(), targetStamp.end(), 0);
+                    currentStamp = 1;
+                }
+
+                size_t targets = 0;
+                for (const WorkEdge& e : b.out[avoid])
+                {
+                    if (e.node != source && targetStamp[e.node] != currentStamp) { targetStamp[e.node] = currentStamp; targets++; }
+                }
+
+                stamp[source] = currentStamp;
+                dist[source] = 0;
+                open.push(source, 0);
+                for (size_t settled = 0; targets > 0 && !open.empty() && open.minKey() <= maxDist && settled < MaxSettled; settled++)
+                {
+                    const uint32_t n = open.pop();
+                    if (targetStamp[n] == currentStamp) { targets--; }
+                    for (const WorkEdge& e : b.out[n])
+                    {
+                        if (e.node == avoid || b.contracted[e.node]) { continue; }
+                        const float d = dist[n] + e.weight;
+                        if (stamp[e.node] == currentStamp && d >= dist[e.node]) { continue; }
+                        stamp[e.node] = currentStamp;
+                        dist[e.node] = d;
+                        open.push(e.node, d);
+                    }
+                }
+                open.clear();
+            }
+
+            float distance(uint32_t node) const
+            {
+                return stamp[node] == currentStamp ? dist[node] : std::numeric_limits<float>::infinity();
+            }
+        };
+
+        const size_t                        numThreads;
+        std::vector<std::vector<WorkEdge>>  out;
+        std::vector<std::vector<WorkEdge>>  in;
+        std::vector<Edge>                   edges;
+        std::vector<uint8_t>                contracted;
+        std::vector<uint32_t>               ranks;
+        std::vector<int32_t>                priorities;
+        std::vector<uint32_t>               contractedNeighbors;
+        std::vector<WitnessSearch>          searches;       // one per thread
+
+        Builder(const DirectedGraph& directed, size_t numNodes, size_t numThreads)
+            : numThreads(std::max<size_t>(1, numThreads))
+            , out(numNodes)
+            , in(numNodes)
+            , contracted(numNodes, 0)
+            , ranks(numNodes, None)
+            , priorities(numNodes, 0)
+            , contractedNeighbors(numNodes, 0)
+            , searches(this->numThreads)
+        {
+            const DirectedGraph::Adjacency& forward = directed.forward();
+            for (uint32_t n = 0; n < numNodes; n++)
+            {
+                for (uint32_t e = forward.beginEdge(n); e < forward.endEdge(n); e++)
+                {
+                    if (forward.target(e) != n) { addEdge({ n, forward.target(e), forward.weight(e), forward.graphEdge(e), None }); }
+                }
+            }
+        }
+
+        // keeps only the cheapest edge between two nodes. a cheaper shortcut is added as a new edge
+        // rather than written over the old one, so every shortcut comes after the two edges it is
+        // made of, which is what lets load() rule out cycles. the old edge is left unused
+        void addEdge(const Shortcut& s)
+        {
+            const uint32_t id = uint32_t(edges.size());
+            for (WorkEdge& e : out[s.from])
+            {
+                if (e.node != s.to) { continue; }
+                if (s.weight < e.weight)
+                {
+                    edges.push_back({ s.to, s.weight, s.first, s.second });
+                    e = { s.to, s.weight, id };
+                    for (WorkEdge& r : in[s.to]) { if (r.node == s.from) { r = { s.from, s.weight, id }; } }
+                }
+                return;
+            }
+
+            edges.push_back({ s.to, s.weight, s.first, s.second });
+            out[s.from].push_back({ s.to, s.weight, id });
+            in[s.to].push_back({ s.from, s.weight, id });
+        }
+
+        // calls f(shortcut) for every shortcut contracting the node needs
+        template <class F>
+        void findShortcuts(uint32_t node, WitnessSearch& search, F&& f) const
+        {
+            float maxOut = 0;
+            for (const WorkEdge& o : out[node]) { maxOut = std::max(maxOut, o.weight); }
+
+            for (const WorkEdge& i : in[node])
+            {
+                search.run(*this, i.node, node, i.weight + maxOut);
+                for (const WorkEdge& o : out[node])
+                {
+                    if (o.node == i.node) { continue; }
+                    const float via = i.weight + o.weight;
+                    if (search.distance(o.node) <= via) { continue; }
+                    f(Shortcut{ i.node, o.node, via, i.edge, o.edge });
+                }
+            }
+        }
+
+        int32_t computePriority(uint32_t node, WitnessSearch& search) const
+        {
+            int32_t shortcuts = 0;
+            findShortcuts(node, search, [&](const Shortcut&) { shortcuts++; });
+            const int32_t edgeDifference = shortcuts - int32_t(out[node].size() + in[node].size());
+            return 2 * edgeDifference + int32_t(contractedNeighbors[node]);
+        }
+
+        // ties are broken by a hash of the node, the node order itself follows the map
+        static uint32_t tieBreak(uint32_t node)
+        {
+            node ^= node >> 16;
+            node *= 0x7feb352du;
+            node ^= node >> 15;
+            return node;
+        }
+
+        bool isLocalMinimum(uint32_t node) const
+        {
+            auto before = [&](uint32_t other)
+            {
+                return priorities[other] < priorities[node] || (priorities[other] == priorities[node] && tieBreak(other) < tieBreak(node));
+            };
+            for (const WorkEdge& e : out[node]) { if (before(e.node)) { return false; } }
+            for (const WorkEdge& e : in[node])  { if (before(e.node)) { return false; } }
+            return true;
+        }
+
+        void updatePriorities(const std::vector<uint32_t>& nodes)
+        {
+            parallelFor(numThreads, nodes.size(), [&](size_t t, size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++) { priorities[nodes[i]] = computePriority(nodes[i], searches[t]); }
+            }, 256);
+        }
+
+        // returns false if it was cancelled before every node was contracted
+        bool contract(const std::atomic<bool>* cancel)
+        {
+            std::vector<uint32_t> remaining(out.size());
+            for (uint32_t n = 0; n < remaining.size(); n++) { remaining[n] = n; }
+            updatePriorities(remaining);
+
+            uint32_t nextRank = 0;
+            std::vector<uint8_t> selected;
+            std::vector<uint32_t> touched;
+            std::vector<uint8_t> isTouched(out.size(), 0);
+            while (!remaining.empty())
+            {
+                if (cancel && *cancel) { return false; }
+
+                // the nodes that come before all their neighbors, no two of which are neighbors
+                selected.assign(remaining.size(), 0);
+                parallelFor(numThreads, remaining.size(), [&](size_t, size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; i++) { selected[i] = isLocalMinimum(remaining[i]); }
+                }, 1024);
+
+                std::vector<uint32_t> round;
+                size_t kept = 0;
+                for (size_t i = 0; i < remaining.size(); i++)
+                {
+                    if (selected[i]) { round.push_back(remaining[i]); }
+                    else             { remaining[kept++] = remaining[i]; }
+                }
+                remaining.resize(kept);
+
+                // nodes of this round are marked first, so witnesses never pass through any of them
+                for (uint32_t n : round)
+                {
+                    contracted[n] = 1;
+                    ranks[n] = nextRank++;
+                }
+
+                std::vector<std::vector<Shortcut>> shortcuts(numThreads);
+                parallelFor(numThreads, round.size(), [&](size_t t, size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        findShortcuts(round[i], searches[t], [&](const Shortcut& s) { shortcuts[t].push_back(s); });
+                    }
+                }, 64);
+
+                // a contracted node keeps its edges, which from now on all lead to higher ranked nodes
+                touched.clear();
+                for (uint32_t n : round)
+                {
+                    for (const WorkEdge& e : out[n]) { eraseEdge(in[e.node], n); touch(e.node, touched, isTouched); }
+                    for (const WorkEdge& e : in[n])  { eraseEdge(out[e.node], n); touch(e.node, touched, isTouched); }
+                }
+                for (const std::vector<Shortcut>& threadShortcuts : shortcuts)
+                {
+                    for (const Shortcut& s : threadShortcuts) { addEdge(s); }
+                }
+
+                for (uint32_t n : touched) { isTouched[n] = 0; }
+                updatePriorities(touched);
+            }
+            return true;
+        }
+
+        void touch(uint32_t node, std::vector<uint32_t>& touched, std::vector<uint8_t>& isTouched)
+        {
+            contractedNeighbors[node]++;
+            if (!isTouched[node]) { isTouched[node] = 1; touched.push_back(node); }
+        }
+
+        static void eraseEdge(std::vector<WorkEdge>& edges, uint32_t node)
+        {
+            edges.erase(std::remove_if(edges.begin(), edges.end(), [&](const WorkEdge& e) { return e.node == node; }), edges.end());
+        }
+    };
+};
@@ -0,0 +1,440 @@
+#pragma once
+
+#include "Graph.hpp"
+#include "DirectedGraph.hpp"
+#include "MultilevelPartition.hpp"
+#include "AStarSearch.hpp"
+#include "BinaryHeap.hpp"
+#include "ParallelFor.hpp"
+#include "Timer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// customizable route planning over the directed graph of one travel mode
+//
+// preprocessing is split in two. the first stage only looks at which edges exist: it partitions
+// the nodes into nested cells and finds the boundary of every cell, the nodes with an edge into
+// the cell from outside (entries) and out of it (exits). the second stage, customization, looks at
+// the weights: for every cell it computes the travel time from each entry to each exit through the
+// cell, a small clique of shortcuts. the cells of a level are independent and run in parallel, and
+// a level above searches the cliques of the level below instead of the graph, so changing the
+// speed of a road class only repeats the customization, not the partition
+//
+// a query is a bidirectional dijkstra that uses the original edges in the finest cells of the start
+// and the goal, and further away the cliques of the highest level whose cell holds neither of them
+class CustomizableRoutePlanner
+{
+    static constexpr uint32_t None = UINT32_MAX;
+    static constexpr float    Unreachable = std::numeric_limits<float>::infinity();
+
+    // the boundary of the cells of one level and the travel times across them
+    struct Level
+    {
+        std::vector<uint32_t>   entryOffsets{ 0 };      // by cell
+        std::vector<uint32_t>   entries;
+        std::vector<uint32_t>   exitOffsets{ 0 };
+        std::vector<uint32_t>   exits;
+        std::vector<uint32_t>   cliqueOffsets{ 0 };
+        std::vector<float>      cliques;                // per cell the travel time from each entry to each exit, by entry
+        std::vector<uint32_t>   entryIndex;             // by boundary node, its position among the entries of its cell, or None
+        std::vector<uint32_t>   exitIndex;
+    };
+
+    // the dijkstra state of one search, valid where its stamp is current, see AStarSearch
+    struct State
+    {
+        std::vector<float>      dist;
+        std::vector<uint32_t>   parent;
+        std::vector<uint32_t>   parentEdge;             // the graph edge a node was reached by, None for a clique
+        std::vector<int8_t>     parentLevel;            // the level of the clique a node was reached by
+        std::vector<uint32_t>   stamp;
+        uint32_t                currentStamp = 0;
+        BinaryHeap              open;
+        size_t                  settled = 0;
+
+        void start(size_t numNodes)
+        {
+            settled = 0;
+            open.clear();
+            if (stamp.size() != numNodes)
+            {
+                dist.assign(numNodes, 0.0f);
+                parent.assign(numNodes, None);
+                parentEdge.assign(numNodes, None);
+                parentLevel.assign(numNodes, -1);
+                stamp.assign(numNodes, 0);
+                open.resize(numNodes);
+                currentStamp = 0;
+            }
+            if (++currentStamp == 0)
+            {
+                std::fill(stamp.begin(), stamp.end(), 0);
+                currentStamp = 1;
+            }
+        }
+
+        bool isReached(uint32_t node) const
+        {
+            return stamp[node] == currentStamp;
+        }
+
+        // returns false if the node was already reached at least as cheaply
+        bool reach(uint32_t node, float d, uint32_t from, uint32_t edge, int level)
+        {
+            if (isReached(node) && d >= dist[node]) { return false; }
+            stamp[node] = currentStamp;
+            dist[node] = d;
+            parent[node] = from;
+            parentEdge[node] = edge;
+            parentLevel[node] = int8_t(level);
+            open.push(node, d);
+            return true;
+        }
+
+        size_t getMemoryBytes() const
+        {
+            return dist.capacity() * sizeof(float) + (parent.capacity() + parentEdge.capacity() + stamp.capacity()) * sizeof(uint32_t)
+                 + parentLevel.capacity() + open.getMemoryBytes();
+        }
+    };
+
+    // a step of a path, an original edge or a clique of some level
+    struct Hop
+    {
+        uint32_t    from;
+        uint32_t    to;
+        uint32_t    edge;
+        int         level;
+    };
+
+    size_t                  m_numNodes = 0;
+    MultilevelPartition     m_partition;
+    std::vector<uint32_t>   m_boundaryIds;      // by node, its index among the nodes on the boundary of a finest cell, or None
+    std::vector<Level>      m_levels;
+    size_t                  m_numBoundaryNodes = 0;
+
+    State       m_sides[2];                     // forward from the start, backward from the goal
+    State       m_unpack;                       // reruns the cell searches behind the cliques of a path
+
+public:
+
+    bool empty() const
+    {
+        return m_numNodes == 0;
+    }
+
+    const MultilevelPartition& getPartition() const
+    {
+        return m_partition;
+    }
+
+    size_t numLevels() const
+    {
+        return m_levels.size();
+    }
+
+    size_t numBoundaryNodes(size_t level) const
+    {
+        return m_levels[level].entries.size() + m_levels[level].exits.size();
+    }
+
+    size_t numCliqueEdges() const
+    {
+        size_t count = 0;
+        for (const Level& level : m_levels) { count += level.cliques.size(); }
+        return count;
+    }
+
+    void clear()
+    {
+        *this = CustomizableRoutePlanner();
+    }
+
+    size_t getMemoryBytes() const
+    {
+        size_t bytes = m_partition.getMemoryBytes() + m_boundaryIds.capacity() * sizeof(uint32_t);
+        for (const Level& level : m_levels)
+        {
+            bytes += (level.entryOffsets.capacity() + level.entries.capacity() + level.exitOffsets.capacity() + level.exits.capacity()
+                    + level.cliqueOffsets.capacity() + level.entryIndex.capacity() + level.exitIndex.capacity()) * sizeof(uint32_t)
+                   + level.cliques.capacity() * sizeof(float);
+        }
+        return bytes;
+    }
+
+    // the metric independent stage: the partition and the boundary of every cell, the cliques are
+    // left unreachable until customize() is called
+    void build(const Graph& graph, const DirectedGraph& directed, const std::vector<uint32_t>& cellSizes = MultilevelPartition::defaultCellSizes())
+    {
+        clear();
+        m_numNodes = graph.numNodes();
+        m_partition.build(graph, directed, cellSizes);
+        const size_t numLevels = m_partition.numLevels();
+        if (numLevels == 0) { return; }
+
+        // an edge between different cells of a level also joins different cells on every level below
+        std::vector<int8_t> entryLevel(m_numNodes, -1), exitLevel(m_numNodes, -1);
+        const DirectedGraph::Adjacency& forward = directed.forward();
+        for (uint32_t n = 0; n < m_numNodes; n++)
+        {
+            for (uint32_t e = forward.beginEdge(n); e < forward.endEdge(n); e++)
+            {
+                const uint32_t t = forward.target(e);
+                const int8_t level = int8_t(m_partition.crossingLevel(n, t));
+                exitLevel[n] = std::max(exitLevel[n], level);
+                entryLevel[t] = std::max(entryLevel[t], level);
+            }
+        }
+
+        m_boundaryIds.assign(m_numNodes, None);
+        for (uint32_t n = 0; n < m_numNodes; n++)
+        {
+            if (entryLevel[n] >= 0 || exitLevel[n] >= 0) { m_boundaryIds[n] = uint32_t(m_numBoundaryNodes++); }
+        }
+
+        m_levels.resize(numLevels);
+        for (size_t l = 0; l < numLevels; l++)
+        {
+            Level& level = m_levels[l];
+            const uint32_t numCells = m_partition.numCells(l);
+            level.entryIndex.assign(m_numBoundaryNodes, None);
+            level.exitIndex.assign(m_numBoundaryNodes, None);
+            buildBoundary(l, entryLevel, level.entryOffsets, level.entries, level.entryIndex);
+            buildBoundary(l, exitLevel, level.exitOffsets, level.exits, level.exitIndex);
+
+            level.cliqueOffsets.assign(numCells + 1, 0);
+            for (uint32_t c = 0; c < numCells; c++)
+            {
+                const uint32_t numEntries = level.entryOffsets[c + 1] - level.entryOffsets[c];
+                const uint32_t numExits = level.exitOffsets[c + 1] - level.exitOffsets[c];
+                level.cliqueOffsets[c + 1] = level.cliqueOffsets[c] + numEntries * numExits;
+            }
+            level.cliques.assign(level.cliqueOffsets.back(), Unreachable);
+        }
+    }
+
+    // recomputes every clique from the current weights of the directed graph, level by level. each
+    // entry of a level is searched on its own, in parallel, since the top levels have few cells but
+    // many entries. the directed graph has to have the edges build() saw. stops between entries
+    // once cancel is set, the cliques are then only partly customized and the caller has to clear()
+    void customize(const DirectedGraph& directed, size_t numThreads, const std::atomic<bool>* cancel = nullptr)
+    {
+        auto cancelled = [&]() { return cancel && *cancel; };
+        std::vector<State> states(std::max<size_t>(1, numThreads));
+        for (size_t l = 0; l < m_levels.size() && !cancelled(); l++)
+        {
+            Level& level = m_levels[l];
+            parallelFor(numThreads, level.entries.size(), [&](size_t t, size_t begin, size_t end)
+            {
+                State& state = states[t];
+                for (size_t i = begin; i < end && !cancelled(); i++)
+                {
+                    const uint32_t entry = level.entries[i];
+                    const uint32_t c = m_partition.cell(l, entry);
+                    const uint32_t numExits = level.exitOffsets[c + 1] - level.exitOffsets[c];
+                    float* clique = &level.cliques[level.cliqueOffsets[c] + (i - level.entryOffsets[c]) * numExits];
+
+                    searchCell(directed, state, l, entry, None);
+                    for (uint32_t j = 0; j < numExits; j++)
+                    {
+                        const uint32_t exit = level.exits[level.exitOffsets[c] + j];
+                        clique[j] = state.isReached(exit) ? state.dist[exit] : Unreachable;
+                    }
+                }
+            }, 1);
+        }
+    }
+
+    SearchResult search(const Graph& graph, const DirectedGraph& directed, uint32_t start, uint32_t goal)
+    {
+        Timer timer;
+        for (State& s : m_sides) { s.start(m_numNodes); }
+
+        // the level a node is searched on: the highest one on which its cell holds neither end
+        auto queryLevel = [&](uint32_t n) { return std::min(m_partition.crossingLevel(n, start), m_partition.crossingLevel(n, goal)); };
+
+        float mu = Unreachable;
+        uint32_t meet = None;
+        auto reach = [&](int side, uint32_t n, float d, uint32_t parent, uint32_t edge, int level)
+        {
+            if (!m_sides[side].reach(n, d, parent, edge, level)) { return; }
+
+            const State& other = m_sides[1 - side];
+            if (other.isReached(n) && d + other.dist[n] < mu)
+            {
+                mu = d + other.dist[n];
+                meet = n;
+            }
+        };
+
+        reach(0, start, 0.0f, None, None, -1);
+        reach(1, goal, 0.0f, None, None, -1);
+        for (int side = 0; !m_sides[0].open.empty() && !m_sides[1].open.empty(); side = 1 - side)
+        {
+            if (m_sides[0].open.minKey() + m_sides[1].open.minKey() >= mu) { break; }
+
+            State& s = m_sides[side];
+            const uint32_t n = s.open.pop();
+            s.settled++;
+
+            // outside the cells of the start and the goal only edges that leave the node's cell on its level are needed
+            const float g = s.dist[n];
+            const int level = queryLevel(n);
+            const DirectedGraph::Adjacency& edges = side == 0 ? directed.forward() : directed.reverse();
+            for (uint32_t e = edges.beginEdge(n); e < edges.endEdge(n); e++)
+            {
+                const uint32_t t = edges.target(e);
+                if (level >= 0 && m_partition.crossingLevel(n, t) < level) { continue; }
+                reach(side, t, g + edges.weight(e), n, edges.graphEdge(e), -1);
+            }
+            if (level >= 0)
+            {
+                forEachClique(size_t(level), n, side == 1, [&](uint32_t t, float weight) { reach(side, t, g + weight, n, None, level); });
+            }
+        }
+
+        SearchResult result;
+        if (meet != None) { result = tracePath(graph, directed, meet, mu); }
+        result.settled = m_sides[0].settled + m_sides[1].settled;
+        result.settledBackward = m_sides[1].settled;
+        result.millis = timer.getElapsedMillis();
+        return result;
+    }
+
+private:
+
+    // lists the nodes of every cell whose boundary level is at least this level, in node order
+    void buildBoundary(size_t l, const std::vector<int8_t>& boundaryLevel, std::vector<uint32_t>& offsets, std::vector<uint32_t>& nodes, std::vector<uint32_t>& index) const
+    {
+        const uint32_t numCells = m_partition.numCells(l);
+        offsets.assign(numCells + 1, 0);
+        for (uint32_t n = 0; n < m_numNodes; n++)
+        {
+            if (boundaryLevel[n] >= int(l)) { offsets[m_partition.cell(l, n) + 1]++; }
+        }
+        for (uint32_t c = 0; c < numCells; c++) { offsets[c + 1] += offsets[c]; }
+
+        nodes.resize(offsets.back());
+        std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+        for (uint32_t n = 0; n < m_numNodes; n++)
+        {
+            if (boundaryLevel[n] < int(l)) { continue; }
+            const uint32_t c = m_partition.cell(l, n);
+            index[m_boundaryIds[n]] = next[c] - offsets[c];
+            nodes[next[c]++] = n;
+        }
+    }
+
+    // calls relax(node, weight) for the clique edges of a node's cell on a level, from the node if
+    // it is an entry, or into it if it is an exit and backward is set
+    template <class Relax>
+    void forEachClique(size_t l, uint32_t node, bool backward, Relax relax) const
+    {
+        const uint32_t b = m_boundaryIds[node];
+        if (b == None) { return; }
+
+        const Level& level = m_levels[l];
+        const uint32_t c = m_partition.cell(l, node);
+        const uint32_t numExits = level.exitOffsets[c + 1] - level.exitOffsets[c];
+        const float* clique = &level.cliques[level.cliqueOffsets[c]];
+        if (!backward)
+        {
+            const uint32_t i = level.entryIndex[b];
+            if (i == None) { return; }
+            for (uint32_t j = 0; j < numExits; j++)
+            {
+                if (clique[i * numExits + j] != Unreachable) { relax(level.exits[level.exitOffsets[c] + j], clique[i * numExits + j]); }
+            }
+        }
+        else
+        {
+            const uint32_t j = level.exitIndex[b];
+            if (j == None) { return; }
+            const uint32_t numEntries = level.entryOffsets[c + 1] - level.entryOffsets[c];
+            for (uint32_t i = 0; i < numEntries; i++)
+            {
+                if (clique[i * numExits + j] != Unreachable) { relax(level.entries[level.entryOffsets[c] + i], clique[i * numExits + j]); }
+            }
+        }
+    }
+
+    // dijkstra from a node through its cell on a level, until target is settled, or with target
+    // None until every exit of the cell is. a cell of the finest level is searched over its own
+    // edges, a cell above over the cliques of the cells below it and the edges between them
+    void searchCell(const DirectedGraph& directed, State& state, size_t l, uint32_t source, uint32_t target) const
+    {
+        state.start(m_numNodes);
+        state.reach(source, 0.0f, None, None, -1);
+
+        const Level& level = m_levels[l];
+        const uint32_t c = m_partition.cell(l, source);
+        uint32_t exitsLeft = level.exitOffsets[c + 1] - level.exitOffsets[c];
+
+        const DirectedGraph::Adjacency& forward = directed.forward();
+        const int below = int(l) - 1;
+        while (!state.open.empty())
+        {
+            const uint32_t n = state.open.pop();
+            if (n == target) { break; }
+            if (target == None && m_boundaryIds[n] != None && level.exitIndex[m_boundaryIds[n]] != None && --exitsLeft == 0) { break; }
+
+            const float g = state.dist[n];
+            for (uint32_t e = forward.beginEdge(n); e < forward.endEdge(n); e++)
+            {
+                const uint32_t t = forward.target(e);
+                if (m_partition.crossingLevel(n, t) != below) { continue; }
+                state.reach(t, g + forward.weight(e), n, forward.graphEdge(e), -1);
+            }
+            if (below >= 0)
+            {
+                forEachClique(size_t(below), n, false, [&](uint32_t t, float weight) { state.reach(t, g + weight, n, None, below); });
+            }
+        }
+    }
+
+    // the forward parents lead from the meeting node back to the start, the backward parents on
+    // to the goal. the cliques on the way are unpacked into graph edges
+    SearchResult tracePath(const Graph& graph, const DirectedGraph& directed, uint32_t meet, float cost)
+    {
+        std::vector<Hop> hops;
+        for (uint32_t n = meet; m_sides[0].parent[n] != None; n = m_sides[0].parent[n])
+        {
+            hops.push_back({ m_sides[0].parent[n], n, m_sides[0].parentEdge[n], m_sides[0].parentLevel[n] });
+        }
+        std::reverse(hops.begin(), hops.end());
+        for (uint32_t n = meet; m_sides[1].parent[n] != None; n = m_sides[1].parent[n])
+        {
+            hops.push_back({ n, m_sides[1].parent[n], m_sides[1].parentEdge[n], m_sides[1].parentLevel[n] });
+        }
+
+        SearchResult result;
+        result.cost = cost;
+        result.path.push_back(hops.empty() ? meet : hops.front().from);
+        for (const Hop& hop : hops) { appendHop(graph, directed, hop, result); }
+        return result;
+    }
+
+    void appendHop(const Graph& graph, const DirectedGraph& directed, const Hop& hop, SearchResult& result)
+    {
+        if (hop.level < 0)
+        {
+            result.path.push_back(hop.to);
+            result.length += graph.length(hop.edge);
+            return;
+        }
+
+        // the clique's cell search finds the same path again, one level further down
+        searchCell(directed, m_unpack, size_t(hop.level), hop.from, hop.to);
+        std::vector<Hop> hops;
+        for (uint32_t n = hop.to; n != hop.from; n = m_unpack.parent[n])
+        {
+            hops.push_back({ m_unpack.parent[n], n, m_unpack.parentEdge[n], m_unpack.parentLevel[n] });
+        }
+        std::reverse(hops.begin(), hops.end());
+        for (const Hop& h : hops) { appendHop(graph, directed, h, result); }
+    }
+};
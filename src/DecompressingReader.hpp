@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// compressed input support is optional, the Makefile enables it with these defines
+#ifdef NLMAP_WITH_ZLIB
+    #include <zlib.h>
+#endif
+
+#ifdef NLMAP_WITH_ZSTD
+    #include <zstd.h>
+#endif
+
+// decompresses a gzip or zstd file on a background thread and hands the output
+// to the caller in blocks, so decompression overlaps with parsing and the
+// decompressed data never has to be written to disk or held in memory all at once
+class DecompressingReader
+{
+public:
+
+    enum Format { None, Gzip, Zstd };
+
+private:
+
+    std::thread                     m_thread;
+    std::mutex                      m_mutex;
+    std::condition_variable         m_cv;
+    std::deque<std::vector<char>>   m_blocks;
+    size_t                          m_maxBlocks = 3;
+    size_t                          m_blockSize = 4 << 20;
+    bool                            m_finished = false;
+    bool                            m_cancel = false;
+    std::string                     m_error;
+    size_t                          m_compressedBytesRead = 0;
+
+public:
+
+    DecompressingReader() = default;
+
+    ~DecompressingReader()
+    {
+        stop();
+    }
+
+    DecompressingReader(const DecompressingReader&) = delete;
+    DecompressingReader& operator=(const DecompressingReader&) = delete;
+
+    // detects the compression format from the magic bytes at the start of the file
+    static Format detect(const char* data, size_t size)
+    {
+        const unsigned char* d = reinterpret_cast<const unsigned char*>(data);
+        if (size >= 2 && d[0] == 0x1f && d[1] == 0x8b)                                  { return Gzip; }
+        if (size >= 4 && d[0] == 0x28 && d[1] == 0xb5 && d[2] == 0x2f && d[3] == 0xfd)  { return Zstd; }
+        return None;
+    }
+
+    static const char* getFormatName(Format format)
+    {
+        switch (format)
+        {
+            case Gzip: return "gzip";
+            case Zstd: return "zstd";
+            default:   return "uncompressed";
+        }
+    }
+
+    // starts decompressing [data, data + size) on a background thread
+    // the data must stay valid until the reader is stopped or destroyed
+    bool start(const char* data, size_t size, Format format, size_t blockSize)
+    {
+        stop();
+
+        m_blockSize = blockSize;
+        m_finished = false;
+        m_cancel = false;
+        m_error.clear();
+        m_compressedBytesRead = 0;
+
+        if (format == Gzip)
+        {
+#ifdef NLMAP_WITH_ZLIB
+            m_thread = std::thread([this, data, size]() { decompressGzip(data, size); });
+            return true;
+#else
+            m_error = "gzip input requires building with NLMAP_WITH_ZLIB";
+            return false;
+#endif
+        }
+
+        if (format == Zstd)
+        {
+#ifdef NLMAP_WITH_ZSTD
+            m_thread = std::thread([this, data, size]() { decompressZstd(data, size); });
+            return true;
+#else
+            m_error = "zstd input requires building with NLMAP_WITH_ZSTD";
+            return false;
+#endif
+        }
+
+        m_error = "input is not compressed";
+        return false;
+    }
+
+    // waits for the next block of decompressed data, returns false once the stream has ended
+    bool next(std::vector<char>& block)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return !m_blocks.empty() || m_finished; });
+        if (m_blocks.empty()) { return false; }
+
+        block = std::move(m_blocks.front());
+        m_blocks.pop_front();
+        m_cv.notify_all();
+        return true;
+    }
+
+    // stops the background thread, discarding any data that has not been read yet
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cancel = true;
+        }
+        m_cv.notify_all();
+
+        if (m_thread.joinable()) { m_thread.join(); }
+        m_blocks.clear();
+    }
+
+    size_t getCompressedBytesRead()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_compressedBytesRead;
+    }
+
+    // the reason decompression failed, empty if the whole stream was read successfully
+    std::string getError()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_error;
+    }
+
+private:
+
+    // called by the decompression thread, waits while the queue is full
+    // returns false if the reader was stopped and decompression should end
+    bool push(std::vector<char>& block, size_t compressedBytesRead)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_blocks.size() < m_maxBlocks || m_cancel; });
+        if (m_cancel) { return false; }
+
+        m_blocks.push_back(std::move(block));
+        m_compressedBytesRead = compressedBytesRead;
+        m_cv.notify_all();
+        return true;
+    }
+
+    void finish(const std::string& error)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_finished = true;
+            m_error = error;
+        }
+        m_cv.notify_all();
+    }
+
+#ifdef NLMAP_WITH_ZLIB
+    void decompressGzip(const char* data, size_t size)
+    {
+        z_stream stream{};
+
+        // 15 + 32 lets zlib detect gzip or zlib headers automatically
+        if (inflateInit2(&stream, 15 + 32) != Z_OK) { finish("could not initialize zlib"); return; }
+
+        size_t consumed = 0;
+        std::string error;
+        std::vector<char> block(m_blockSize);
+        size_t blockUsed = 0;
+
+        while (true)
+        {
+            // avail_in is 32 bit, so very large files are fed to zlib in slices
+            if (stream.avail_in == 0 && consumed < size)
+            {
+                size_t slice = std::min<size_t>(size - consumed, 1u << 30);
+                stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + consumed));
+                stream.avail_in = uInt(slice);
+                consumed += slice;
+            }
+
+            stream.next_out = reinterpret_cast<Bytef*>(block.data() + blockUsed);
+            stream.avail_out = uInt(block.size() - blockUsed);
+
+            int result = inflate(&stream, Z_NO_FLUSH);
+            blockUsed = block.size() - stream.avail_out;
+            size_t bytesRead = consumed - stream.avail_in;
+
+            if (result == Z_STREAM_END)
+            {
+                // a gzip file may be several members concatenated together, each starting with 1f 8b
+                // anything else after a member, like the zero padding of some tools, is ignored as gzip does
+                if (size - bytesRead >= 2 && uint8_t(data[bytesRead]) == 0x1f && uint8_t(data[bytesRead + 1]) == 0x8b)
+                {
+                    inflateReset(&stream);
+                    continue;
+                }
+                break;
+            }
+
+            if (result != Z_OK && result != Z_BUF_ERROR) { error = "corrupt gzip data"; break; }
+            if (result == Z_BUF_ERROR && stream.avail_in == 0 && consumed == size && blockUsed < block.size()) { error = "truncated gzip data"; break; }
+
+            if (blockUsed == block.size())
+            {
+                if (!push(block, bytesRead)) { inflateEnd(&stream); return; }
+                block.assign(m_blockSize, 0);
+                blockUsed = 0;
+            }
+        }
+
+        inflateEnd(&stream);
+
+        block.resize(blockUsed);
+        if (!block.empty() && !push(block, size)) { return; }
+        finish(error);
+    }
+#endif
+
+#ifdef NLMAP_WITH_ZSTD
+    void decompressZstd(const char* data, size_t size)
+    {
+        ZSTD_DStream* stream = ZSTD_createDStream();
+        if (!stream) { finish("could not initialize zstd"); return; }
+        ZSTD_initDStream(stream);
+
+        ZSTD_inBuffer input = { data, size, 0 };
+        std::string error;
+        std::vector<char> block(m_blockSize);
+        size_t blockUsed = 0;
+        size_t lastResult = 0;
+        bool outputFull = false;
+
+        // a call that fills the whole output block may have left more data inside zstd
+        while (input.pos < input.size || outputFull)
+        {
+            ZSTD_outBuffer output = { block.data(), block.size(), blockUsed };
+            lastResult = ZSTD_decompressStream(stream, &output, &input);
+            if (ZSTD_isError(lastResult)) { error = ZSTD_getErrorName(lastResult); break; }
+            blockUsed = output.pos;
+            outputFull = (output.pos == output.size);
+
+            if (blockUsed == block.size())
+            {
+                if (!push(block, input.pos)) { ZSTD_freeDStream(stream); return; }
+                block.assign(m_blockSize, 0);
+                blockUsed = 0;
+            }
+        }
+
+        // a non zero result after all input is consumed means the last frame was cut off
+        if (error.empty() && lastResult != 0) { error = "truncated zstd data"; }
+
+        ZSTD_freeDStream(stream);
+
+        block.resize(blockUsed);
+        if (!block.empty() && !push(block, size)) { return; }
+        finish(error);
+    }
+#endif
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "Graph.hpp"
+#include "TravelMode.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// the edges of the graph one travel mode may legally use, in both directions
+//
+// the forward adjacency holds the edges leaving each node and the reverse adjacency the edges
+// entering it, each as its own csr arrays, so a search from the start and a search backwards
+// from the goal both expand only legal edges. every directed edge carries its weight for the
+// mode and the index of the undirected graph edge it comes from
+class DirectedGraph
+{
+public:
+
+    class Adjacency
+    {
+        friend class DirectedGraph;
+
+        std::vector<uint32_t>   m_offsets{ 0 };
+        std::vector<uint32_t>   m_targets;          // the node an edge leads to, or comes from in the reverse adjacency
+        std::vector<float>      m_weights;
+        std::vector<uint32_t>   m_graphEdges;       // the undirected graph edge of each directed edge
+
+    public:
+
+        uint32_t beginEdge(size_t node) const
+        {
+            return m_offsets[node];
+        }
+
+        uint32_t endEdge(size_t node) const
+        {
+            return m_offsets[node + 1];
+        }
+
+        uint32_t target(uint32_t edge) const
+        {
+            return m_targets[edge];
+        }
+
+        float weight(uint32_t edge) const
+        {
+            return m_weights[edge];
+        }
+
+        uint32_t graphEdge(uint32_t edge) const
+        {
+            return m_graphEdges[edge];
+        }
+
+        size_t numEdges() const
+        {
+            return m_targets.size();
+        }
+
+        const std::vector<uint32_t>& getOffsets() const
+        {
+            return m_offsets;
+        }
+
+        const std::vector<uint32_t>& getTargets() const
+        {
+            return m_targets;
+        }
+
+        const std::vector<float>& getWeights() const
+        {
+            return m_weights;
+        }
+
+        const std::vector<uint32_t>& getGraphEdges() const
+        {
+            return m_graphEdges;
+        }
+
+        size_t getMemoryBytes() const
+        {
+            return (m_offsets.capacity() + m_targets.capacity() + m_graphEdges.capacity()) * sizeof(uint32_t) + m_weights.capacity() * sizeof(float);
+        }
+    };
+
+private:
+
+    Adjacency m_forward;
+    Adjacency m_reverse;
+    float     m_maxSpeed = 0;       // the fastest legal edge in meters per second, for search heuristics
+
+public:
+
+    // wayDirections holds the AccessRules::Direction bits of every way and waySpeeds its speed for
+    // this mode in meters per second, every edge is weighted by its travel time in seconds
+    void build(const Graph& graph, const std::vector<uint8_t>& wayDirections, const std::vector<float>& waySpeeds)
+    {
+        const size_t numNodes = graph.numNodes();
+        auto isLegal = [&](uint32_t e)
+        {
+            return (wayDirections[graph.edgeWay(e)] & (graph.isAgainstWay(e) ? AccessRules::Backward : AccessRules::Forward)) != 0;
+        };
+
+        // the graph stores every road segment once per direction, so its legal edges leaving a node
+        // are that node's forward edges and, transposed, the reverse edges of their targets
+        m_forward.m_offsets.assign(numNodes + 1, 0);
+        m_reverse.m_offsets.assign(numNodes + 1, 0);
+        for (size_t n = 0; n < numNodes; n++)
+        {
+            for (uint32_t e = graph.beginEdge(n); e < graph.endEdge(n); e++)
+            {
+                if (!isLegal(e)) { continue; }
+                m_forward.m_offsets[n + 1]++;
+                m_reverse.m_offsets[graph.target(e) + 1]++;
+            }
+        }
+        for (size_t n = 0; n < numNodes; n++)
+        {
+            m_forward.m_offsets[n + 1] += m_forward.m_offsets[n];
+            m_reverse.m_offsets[n + 1] += m_reverse.m_offsets[n];
+        }
+
+        for (Adjacency* adjacency : { &m_forward, &m_reverse })
+        {
+            const size_t numEdges = adjacency->m_offsets.back();
+            adjacency->m_targets.resize(numEdges);
+            adjacency->m_weights.resize(numEdges);
+            adjacency->m_graphEdges.resize(numEdges);
+        }
+
+        std::vector<uint32_t> nextReverse(m_reverse.m_offsets.begin(), m_reverse.m_offsets.end() - 1);
+        uint32_t f = 0;
+        m_maxSpeed = 0;
+        for (size_t n = 0; n < numNodes; n++)
+        {
+            for (uint32_t e = graph.beginEdge(n); e < graph.endEdge(n); e++)
+            {
+                if (!isLegal(e)) { continue; }
+
+                const float weight = graph.length(e) / waySpeeds[graph.edgeWay(e)];
+                m_maxSpeed = std::max(m_maxSpeed, waySpeeds[graph.edgeWay(e)]);
+                m_forward.m_targets[f] = graph.target(e);
+                m_forward.m_weights[f] = weight;
+                m_forward.m_graphEdges[f++] = e;
+
+                uint32_t r = nextReverse[graph.target(e)]++;
+                m_reverse.m_targets[r] = uint32_t(n);
+                m_reverse.m_weights[r] = weight;
+                m_reverse.m_graphEdges[r] = e;
+            }
+        }
+    }
+
+    // new speeds for the same legal edges, the edges and their order stay as build() made them
+    // returns false if no weight changed
+    bool setWeights(const Graph& graph, const std::vector<float>& waySpeeds)
+    {
+        bool changed = false;
+        m_maxSpeed = 0;
+        for (Adjacency* adjacency : { &m_forward, &m_reverse })
+        {
+            for (size_t e = 0; e < adjacency->m_weights.size(); e++)
+            {
+                const uint32_t graphEdge = adjacency->m_graphEdges[e];
+                const float weight = graph.length(graphEdge) / waySpeeds[graph.edgeWay(graphEdge)];
+                changed |= weight != adjacency->m_weights[e];
+                adjacency->m_weights[e] = weight;
+                m_maxSpeed = std::max(m_maxSpeed, waySpeeds[graph.edgeWay(graphEdge)]);
+            }
+        }
+        return changed;
+    }
+
+    const Adjacency& forward() const
+    {
+        return m_forward;
+    }
+
+    const Adjacency& reverse() const
+    {
+        return m_reverse;
+    }
+
+    size_t numEdges() const
+    {
+        return m_forward.numEdges();
+    }
+
+    float getMaxSpeed() const
+    {
+        return m_maxSpeed;
+    }
+
+    size_t getMemoryBytes() const
+    {
+        return m_forward.getMemoryBytes() + m_reverse.getMemoryBytes();
+    }
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// gives every distinct 64 bit key a dense index, numbered in the order the keys were first inserted
+// used to deduplicate nodes by their packed coordinate id
+//
+// it is an open addressing table probed linearly, whose 8 byte slots hold only the index of a key
+// and a few bits of its hash. the keys themselves live in one flat array in index order, so
+// there is no allocation per entry and a probe usually touches a single cache line of the table
+class FlatIndexMap
+{
+    struct Slot
+    {
+        uint32_t index;
+        uint32_t hash;      // the upper hash bits, so most mismatches never look at the key array
+    };
+
+    std::vector<Slot>       m_slots;
+    std::vector<uint64_t>   m_keys;
+    size_t                  m_mask = 0;
+
+public:
+
+    static constexpr uint32_t Missing = UINT32_MAX;
+
+    FlatIndexMap() = default;
+
+    explicit FlatIndexMap(size_t numKeys)
+    {
+        reserve(numKeys);
+    }
+
+    // makes room for numKeys distinct keys without growing, at a load factor of at most 3/4
+    void reserve(size_t numKeys)
+    {
+        size_t capacity = std::bit_ceil(std::max<size_t>(16, numKeys + numKeys / 3 + 1));
+        if (capacity > m_slots.size()) { rehash(capacity); }
+    }
+
+    // returns the index of key, and whether the key was new and has just been given the next index
+    std::pair<uint32_t, bool> insert(uint64_t key)
+    {
+        if ((m_keys.size() + 1) * 4 > m_slots.size() * 3) { rehash(std::max<size_t>(16, m_slots.size() * 2)); }
+
+        uint64_t h = hash(key);
+        uint32_t tag = uint32_t(h >> 32);
+        for (size_t i = size_t(h) & m_mask; ; i = (i + 1) & m_mask)
+        {
+            Slot& slot = m_slots[i];
+            if (slot.index == Missing)
+            {
+                slot = { uint32_t(m_keys.size()), tag };
+                m_keys.push_back(key);
+                return { slot.index, true };
+            }
+
+            if (slot.hash == tag && m_keys[slot.index] == key) { return { slot.index, false }; }
+        }
+    }
+
+    // the index of key, or Missing if it was never inserted
+    uint32_t find(uint64_t key) const
+    {
+        if (m_slots.empty()) { return Missing; }
+
+        uint64_t h = hash(key);
+        uint32_t tag = uint32_t(h >> 32);
+        for (size_t i = size_t(h) & m_mask; ; i = (i + 1) & m_mask)
+        {
+            const Slot& slot = m_slots[i];
+            if (slot.index == Missing) { return Missing; }
+            if (slot.hash == tag && m_keys[slot.index] == key) { return slot.index; }
+        }
+    }
+
+    uint64_t getKey(uint32_t index) const
+    {
+        return m_keys[index];
+    }
+
+    size_t size() const
+    {
+        return m_keys.size();
+    }
+
+    void clear()
+    {
+        m_slots = std::vector<Slot>();
+        m_keys = std::vector<uint64_t>();
+        m_mask = 0;
+    }
+
+    size_t getMemoryBytes() const
+    {
+        return m_slots.capacity() * sizeof(Slot) + m_keys.capacity() * sizeof(uint64_t);
+    }
+
+private:
+
+    // packed coordinate ids have very regular bits, so they are fully mixed before probing
+    static uint64_t hash(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        key ^= key >> 33;
+        return key;
+    }
+
+    void rehash(size_t capacity)
+    {
+        m_slots.assign(capacity, Slot{ Missing, 0 });
+        m_mask = capacity - 1;
+
+        // the keys array already holds everything, so the table is simply rebuilt from it
+        for (uint32_t index = 0; index < m_keys.size(); index++)
+        {
+            uint64_t h = hash(m_keys[index]);
+            size_t i = size_t(h) & m_mask;
+            while (m_slots[i].index != Missing) { i = (i + 1) & m_mask; }
+            m_slots[i] = { index, uint32_t(h >> 32) };
+        }
+    }
+};
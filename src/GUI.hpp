@@ -2,10 +2,21 @@
 
 #include "ViewController.hpp"
 #include "MapData.hpp"
-
+#include "MapCache.hpp"
+#include "WayColumns.hpp"
+#include "LoadProgress.hpp"
+#include "Timer.hpp"
+#include "AStarSearch.hpp"
+#include "BidirectionalSearch.hpp"
+#include "Landmarks.hpp"
+
+#include <string>
 #include <vector>
 #include <map>
 #include <memory>
+#include <thread>
+#include <cstdio>
+#include <fstream>
 #include <SFML/Graphics.hpp>
 
 #include "imgui.h"
@@ -19,6 +30,25 @@ class GUI
     ViewController      m_viewController;
     MapData             m_mapData;
 
+    // the map is loaded into its own MapData on a worker thread and moved into m_mapData when done
+    std::unique_ptr<MapData> m_loadingMap;
+    std::thread         m_loadThread;
+    LoadProgress        m_loadProgress;
+    Timer               m_loadTimer;
+    bool                m_viewSet = false;
+    sf::View            m_initialView;
+    std::string         m_mapFilename;
+
+    // the search structures that take too long to build before the map is shown are prepared per
+    // travel mode on a worker thread afterwards, one at a time and the selected mode first. the gui
+    // only reads a structure once its task has finished, see updatePreparing()
+    enum class Prepared { Overlay, Landmarks, Hierarchy, Count };
+    std::thread         m_prepareThread;
+    LoadProgress        m_prepareProgress;
+    bool                m_prepared[NumTravelModes][size_t(Prepared::Count)] = {};
+    size_t              m_preparingMode = 0;
+    Prepared            m_preparingTask = Prepared::Overlay;
+
     bool                m_drawWays = true;
     bool                m_drawNodes = false;
     int                 m_selectedNode = -1;
@@ -26,9 +56,40 @@ class GUI
     int                 m_startNode = -1;
     int                 m_goalNode = -1;
 
+    // the travel mode searches use, every mode's graph is built at load so switching is free
+    int                 m_travelMode = int(TravelMode::Car);
+    bool                m_dimUnusableWays = false;
+
+    AStarSearch         m_search;
+    BidirectionalSearch m_bidirectionalSearch;
+    SearchResult        m_searchResult;
+    int                 m_heuristic = int(Heuristic::StraightLine);
+    std::vector<uint32_t> m_activeLandmarks;    // the landmarks the last search used
+    std::vector<std::pair<std::string, float>> m_highwaySpeeds;     // the speed table as edited in the speeds tab
+    double              m_speedUpdateMillis = 0;
+    size_t              m_baselineSettled = 0;  // what the same search settled with the straight line heuristic
+    sf::VertexArray     m_routeLines{ sf::PrimitiveType::LineStrip };
+
     sf::VertexArray     m_wayLines{ sf::PrimitiveType::LineStrip };
     sf::VertexArray     m_nodeLines{ sf::PrimitiveType::Lines };
 
+    // tag filters are evaluated over the columnar copy of the way tags
+    struct FilterCondition
+    {
+        bool    enabled = false;
+        int     field = WayTag::Highway;
+        bool    negate = false;
+        char    value[64] = "";
+    };
+
+    WayColumns          m_wayColumns;
+    WayBitset           m_filterMatches;
+    bool                m_filterActive = false;
+    int                 m_filterMode = 0;
+    ImVec4              m_filterColor = ImVec4(0.f, 1.f, 1.f, 1.f);
+    double              m_filterMillis = 0;
+    FilterCondition     m_filterConditions[3];
+
     struct TypeColor 
     {
         std::string type;
@@ -55,13 +116,154 @@ public:
         if (!ImGui::SFML::Init(m_window)) { exit(-1); }
         m_originalStyle = ImGui::GetStyle();
 
-        m_mapData.loadFromFile("ways.txt");
+        startLoading(findMapFile());
+    }
+
+    // the map is read from ways.txt, a gzip / zstd compressed copy of it, or an osm extract
+    static std::string findMapFile()
+    {
+        for (const char* filename : { "ways.txt", "ways.txt.gz", "ways.txt.zst", "map.osm.pbf", "map.osm", "map.osm.gz" })
+        {
+            if (std::ifstream(filename).good()) { return filename; }
+        }
+        return "ways.txt";
+    }
+
+    // loads the map on a worker thread so the window is responsive immediately
+    // ways are drawn as the loader publishes them, see updateLoading()
+    void startLoading(const std::string& filename)
+    {
+        m_loadingMap = std::make_unique<MapData>();
+        m_loadingMap->setProgress(&m_loadProgress);
+        m_loadTimer.start();
+        m_mapFilename = filename;
+
+        m_loadThread = std::thread([this, filename]()
+        {
+            MapCache::loadMap(*m_loadingMap, filename);
+            m_loadProgress.done = true;
+        });
+    }
+
+    // asks the loader to stop early and waits for it, used when the window is closed mid load
+    void stopLoading()
+    {
+        if (!m_loadThread.joinable()) { return; }
+
+        m_loadProgress.cancel = true;
+        m_loadThread.join();
+    }
+
+    // called once per frame while loading: draws newly published ways, and swaps in
+    // the finished map data once the worker thread is done
+    void updateLoading()
+    {
+        if (!m_loadingMap) { return; }
+
+        for (const PreviewWay& way : m_loadProgress.takePending())
+        {
+            appendPreviewWay(way);
+        }
+
+        if (!m_viewSet && m_wayLines.getVertexCount() > 0) { setInitialView(); }
+
+        if (!m_loadProgress.done) { return; }
+
+        m_loadThread.join();
+        m_mapData = std::move(*m_loadingMap);
+        m_mapData.setProgress(&m_prepareProgress);
+        m_loadingMap.reset();
+
+        // rebuild the vertex arrays from the final data, exactly as a blocking load would
+        m_wayColumns.build(m_mapData.getWays());
+        m_routeLines.clear();
+        m_searchResult = SearchResult();
+        m_activeLandmarks.clear();
+        m_highwaySpeeds.clear();
+        m_wayLines.clear();
         loadWayLines();
         loadWayLinesByNode();
-        setInitialView();
+
+        // only fit the whole map if the user hasn't moved away from the preview view yet
+        const sf::View& view = m_window.getView();
+        if (!m_viewSet || (view.getCenter() == m_initialView.getCenter() && view.getSize() == m_initialView.getSize()))
+        {
+            setInitialView();
+        }
+    }
+
+    bool isPrepared(Prepared task) const
+    {
+        return m_prepared[m_travelMode][size_t(task)];
+    }
+
+    // called once per frame once the map is loaded: takes over what the worker finished preparing
+    // and starts on the next missing structure, the selected travel mode's first
+    void updatePreparing()
+    {
+        if (m_loadingMap || m_mapData.getGraph().numNodes() == 0) { return; }
+
+        if (m_prepareThread.joinable())
+        {
+            if (!m_prepareProgress.done) { return; }
+            m_prepareThread.join();
+            m_prepared[m_preparingMode][size_t(m_preparingTask)] = true;
+        }
+
+        for (size_t i = 0; i < NumTravelModes; i++)
+        {
+            const size_t mode = (size_t(m_travelMode) + i) % NumTravelModes;
+            for (size_t task = 0; task < size_t(Prepared::Count); task++)
+            {
+                if (!m_prepared[mode][task]) { startPreparing(mode, Prepared(task)); return; }
+            }
+        }
+    }
+
+    // the worker only writes the structure of its own task, and only reads the graphs otherwise
+    void startPreparing(size_t mode, Prepared task)
+    {
+        m_preparingMode = mode;
+        m_preparingTask = task;
+        m_prepareProgress.done = false;
+        m_prepareProgress.cancel = false;
+
+        m_prepareThread = std::thread([this, mode, task]()
+        {
+            switch (task)
+            {
+                case Prepared::Overlay:   m_mapData.buildRoutePlanner(TravelMode(mode)); break;
+                case Prepared::Landmarks: MapCache::loadLandmarks(m_mapData, m_mapFilename, TravelMode(mode)); break;
+                case Prepared::Hierarchy: MapCache::loadHierarchy(m_mapData, m_mapFilename, TravelMode(mode)); break;
+                default: break;
+            }
+            m_prepareProgress.done = true;
+        });
+    }
+
+    // asks the worker to stop and waits for it, used before the graphs change and when the window
+    // is closed. the unfinished task stays unprepared and is started again by updatePreparing()
+    void stopPreparing()
+    {
+        if (!m_prepareThread.joinable()) { return; }
+
+        m_prepareProgress.cancel = true;
+        m_prepareThread.join();
+    }
+
+    void appendPreviewWay(const PreviewWay& way)
+    {
+        if (way.points.empty()) { return; }
+
+        // same invisible connecting lines between ways as loadWayLines()
+        sf::Color color = getColor(way.highway);
+        if (m_wayLines.getVertexCount() > 0) { m_wayLines.append(sf::Vertex{ way.points.front(), sf::Color(0, 0, 0, 0) }); }
+        for (const sf::Vector2f& p : way.points) { m_wayLines.append(sf::Vertex{ p, color }); }
+        m_wayLines.append(sf::Vertex{ way.points.back(), sf::Color(0, 0, 0, 0) });
     }
 
     // sets the SFML window view to the minimum window that encapsulates all ways
+    // uses the way line vertices, so it also works on the partial map while loading
     void setInitialView() 
     {
         float minX = std::numeric_limits<float>::max();
@@ -69,15 +271,13 @@ public:
         float maxX = std::numeric_limits<float>::lowest();
         float maxY = std::numeric_limits<float>::lowest();
 
-        for (const auto& way : m_mapData.getWays()) 
+        for (size_t i = 0; i < m_wayLines.getVertexCount(); i++) 
         {
-            for (const auto& n : way.nodes) 
-            {
-                if (n.p.x < minX) { minX = n.p.x; }
-                if (n.p.y < minY) { minY = n.p.y; }
-                if (n.p.x > maxX) maxX = n.p.x;
-                if (n.p.y > maxY) maxY = n.p.y;
-            }
+            const sf::Vector2f& p = m_wayLines[i].position;
+            if (p.x < minX) { minX = p.x; }
+            if (p.y < minY) { minY = p.y; }
+            if (p.x > maxX) maxX = p.x;
+            if (p.y > maxY) maxY = p.y;
         }
 
         if (minX == std::numeric_limits<float>::max()) { return; }
@@ -96,6 +296,8 @@ public:
 
         sf::View view(center, size);
         m_window.setView(view);
+        m_initialView = view;
+        m_viewSet = true;
     }
 
     void run()
@@ -104,6 +306,8 @@ public:
         {
             ImGui::SFML::Update(m_window, m_deltaClock.restart());
             m_window.clear();
+            updateLoading();
+            updatePreparing();
             userInput();
             render();
             imgui();
@@ -121,6 +325,8 @@ public:
 
             if (event->is<sf::Event::Closed>())
             {
+                stopLoading();
+                stopPreparing();
                 std::exit(0);
             }
 
@@ -130,15 +336,17 @@ public:
                 sf::Vector2f m(m_window.mapPixelToCoords(mbp->position));
                 if (mbp->button == sf::Mouse::Button::Left)
                 {
+                    // scans the graph's flat position array rather than the full node records
+                    const std::vector<sf::Vector2f>& positions = m_mapData.getGraph().getPositions();
                     float minDist = 10000000;
                     int minIndex = -1;
-                    for (Node& node : m_mapData.getNodes())
+                    for (size_t i = 0; i < positions.size(); i++)
                     {
-                        float dist = (node.p - m).length();
+                        float dist = (positions[i] - m).length();
                         if (dist < minDist)
                         {
                             minDist = dist;
-                            minIndex = int(node.index);
+                            minIndex = int(i);
                         }
                     }
                     m_selectedNode = minIndex;
@@ -173,6 +381,17 @@ public:
         std::cout << "Loading Way Lines into Vertex Array...\n";
         const std::vector<Way>& ways = m_mapData.getWays();
 
+        // look up the color of each distinct highway value once, instead of once per vertex
+        const StringDictionary& highways = m_mapData.getWayData().getTags().getField(WayTag::Highway);
+        std::vector<sf::Color> highwayColors(highways.size());
+        for (uint32_t code = 0; code < highways.size(); code++)
+        {
+            highwayColors[code] = getColor(highways.decode(code));
+        }
+
+        const std::vector<uint8_t>& directions = m_mapData.getWayDirections(TravelMode(m_travelMode));
+        const bool dim = m_dimUnusableWays && directions.size() == ways.size();
+
         for (size_t i=0; i<ways.size(); i++)
         {
             // in order to avoid connecting lines from the end of one way to the beginning of the next
@@ -181,10 +400,11 @@ public:
             if (i > 0) { m_wayLines.append(sf::Vertex{ways[i].nodes[0].p, sf::Color(0, 0, 0, 0)}); }
 
             // now draw the actual line we want
+            sf::Color color = highwayColors[ways[i].getTag(WayTag::Highway)];
+            if (m_filterActive) { color = getFilterColor(i, color); }
+            if (dim && directions[i] == AccessRules::None) { color.a = 40; }
             for (int c = 0; c < ways[i].count; c++)
             {
-                sf::Color color = getColor(ways[i].highway);
-
                 m_wayLines.append(sf::Vertex{ ways[i].nodes[c].p, color});
             }
 
@@ -193,18 +413,51 @@ public:
         }
     }
 
+    // the color of a way with the current tag filter applied
+    // mode 0 highlights matching ways, 1 hides them, 2 hides every way that doesn't match
+    sf::Color getFilterColor(size_t wayIndex, sf::Color color) const
+    {
+        bool match = m_filterMatches.test(wayIndex);
+        const ImVec4& c = m_filterColor;
+
+        if (m_filterMode == 0 && match)  { return sf::Color(uint8_t(c.x * 255.0f), uint8_t(c.y * 255.0f), uint8_t(c.z * 255.0f), 255); }
+        if (m_filterMode == 1 && match)  { return sf::Color(0, 0, 0, 0); }
+        if (m_filterMode == 2 && !match) { return sf::Color(0, 0, 0, 0); }
+        return color;
+    }
+
+    // evaluates every enabled condition over the tag columns and redraws the ways
+    void applyFilter()
+    {
+        Timer timer;
+        const WayTagDictionary& tags = m_mapData.getWayData().getTags();
+
+        m_filterMatches = WayBitset(m_wayColumns.size(), true);
+        for (const FilterCondition& c : m_filterConditions)
+        {
+            if (!c.enabled) { continue; }
+
+            WayBitset matches = m_wayColumns.equals(WayTag::Field(c.field), c.value, tags);
+            m_filterMatches &= c.negate ? ~matches : matches;
+        }
+
+        m_filterMillis = timer.getElapsedMillis();
+        m_filterActive = true;
+        m_wayLines.clear();
+        loadWayLines();
+    }
+
     void loadWayLinesByNode()
     {
         std::cout << "Loading Node Lines into Vertex Array...\n";
-        const std::vector<Node>& nodes = m_mapData.getNodes();
+        const Graph& graph = m_mapData.getGraph();
 
-        for (size_t i = 0; i < nodes.size(); i++)
+        for (size_t i = 0; i < graph.numNodes(); i++)
         {
-            for (auto id : nodes[i].connectedNodeIDs)
+            for (uint32_t ni : graph.neighbors(i))
             {
-                auto& node = m_mapData.getNodeData().getNodeByID(id);
-                m_nodeLines.append(sf::Vertex{ nodes[i].p, sf::Color(255, 255, 255, 255) });
-                m_nodeLines.append(sf::Vertex{ node.p, sf::Color(255, 255, 255, 255) });
+                m_nodeLines.append(sf::Vertex{ graph.position(i), sf::Color(255, 255, 255, 255) });
+                m_nodeLines.append(sf::Vertex{ graph.position(ni), sf::Color(255, 255, 255, 255) });
             }
         }
     }
@@ -213,13 +466,28 @@ public:
     {
         if (m_drawWays) { m_window.draw(m_wayLines); }
         if (m_drawNodes) { m_window.draw(m_nodeLines); }
+        m_window.draw(m_routeLines);
+
+        if (m_heuristic == int(Heuristic::Landmarks) && isPrepared(Prepared::Landmarks))
+        {
+            const Landmarks& landmarks = m_mapData.getLandmarks(TravelMode(m_travelMode));
+            const float radius = m_window.getView().getSize().x / 150;
+            for (size_t l = 0; l < landmarks.size(); l++)
+            {
+                drawCircleAtNode(int(landmarks.node(l)), sf::Color(255, 255, 0, 120), radius);
+            }
+            for (uint32_t l : m_activeLandmarks)
+            {
+                if (l < landmarks.size()) { drawCircleAtNode(int(landmarks.node(l)), sf::Color(255, 140, 0, 230), radius * 1.5f); }
+            }
+        }
 
         if (m_selectedNode != -1)
         {
             float radius = 0.0002f;
             radius = m_window.getView().getSize().x / 100;
             
-            for (uint64_t ni : m_mapData.getNodes()[m_selectedNode].connectedNodeIndexes)
+            for (uint32_t ni : m_mapData.getGraph().neighbors(size_t(m_selectedNode)))
             {
                 drawCircleAtNode(int(ni), sf::Color(0, 255, 0, 200), radius);
             }
@@ -232,7 +500,7 @@ public:
         sf::CircleShape circle(radius, 32);
         circle.setOrigin({ radius, radius });
         circle.setFillColor(c);
-        circle.setPosition(m_mapData.getNodes()[nodeIndex].p);
+        circle.setPosition(m_mapData.getGraph().position(size_t(nodeIndex)));
         m_window.draw(circle);
     }
 
@@ -244,6 +512,13 @@ public:
         {
             if (ImGui::BeginTabItem("Way Info"))
             {
+                if (m_loadingMap) { imguiLoadingProgress(); }
+                if (m_prepareThread.joinable())
+                {
+                    ImGui::Text("Preparing %s: %s", getTravelModeName(TravelMode(m_preparingMode)), m_prepareProgress.stage.load());
+                    ImGui::Separator();
+                }
+
                 ImGui::Text("Ways: %d", int(m_mapData.getWays().size()));
                 ImGui::Text("Nodes: %d", int(m_mapData.getNodes().size()));
                 if (ImGui::Button("Reset View"))
@@ -253,17 +528,106 @@ public:
                 ImGui::Checkbox("Draw Ways", &m_drawWays);
                 ImGui::Checkbox("Draw Nodes", &m_drawNodes);
 
+                bool profileChanged = ImGui::Combo("Profile", &m_travelMode, "Car\0Bike\0Foot\0");
+                profileChanged |= ImGui::Checkbox("Dim Ways Profile Can't Use", &m_dimUnusableWays);
+                if (profileChanged && !m_loadingMap)
+                {
+                    m_wayLines.clear();
+                    loadWayLines();
+                }
+                ImGui::Text("Profile Edges: %d", int(m_mapData.getDirectedGraph(TravelMode(m_travelMode)).numEdges()));
+
                 ImGui::Text("Selected Node ID: %d", m_selectedNode);
                 ImGui::Text("   Start Node ID: %d", m_startNode);
                 ImGui::Text("    Goal Node ID: %d", m_goalNode);
                 if (ImGui::Button("Set Start")) { m_startNode = m_selectedNode; }
                 ImGui::SameLine();
                 if (ImGui::Button("Set Goal"))  { m_goalNode = m_selectedNode; }
-                if (ImGui::Button("Start Search"))
+                ImGui::Combo("Heuristic", &m_heuristic, "None\0Straight Line\0Landmarks\0");
+                if (m_heuristic == int(Heuristic::Landmarks) && !isPrepared(Prepared::Landmarks))
+                {
+                    ImGui::Text("Landmarks not ready, searching with the straight line");
+                }
+                if (ImGui::Button("Start Search") && !m_loadingMap)
+                {
+                    doSearch(m_startNode, m_goalNode, SearchMethod::OneWay);
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Bidirectional Search") && !m_loadingMap)
+                {
+                    doSearch(m_startNode, m_goalNode, SearchMethod::Bidirectional);
+                }
+
+                const ContractionHierarchy& hierarchy = m_mapData.getHierarchy(TravelMode(m_travelMode));
+                if (isPrepared(Prepared::Hierarchy) && !hierarchy.empty())
+                {
+                    if (ImGui::Button("Hierarchy Search") && !m_loadingMap)
+                    {
+                        doSearch(m_startNode, m_goalNode, SearchMethod::Hierarchy);
+                    }
+                    ImGui::SameLine();
+                    ImGui::Text("%d shortcuts", int(hierarchy.numShortcuts()));
+                }
+
+                const CustomizableRoutePlanner& planner = m_mapData.getRoutePlanner(TravelMode(m_travelMode));
+                if (isPrepared(Prepared::Overlay) && !planner.empty())
                 {
-                    doSearch(m_startNode, m_goalNode);
+                    if (ImGui::Button("Overlay Search") && !m_loadingMap)
+                    {
+                        doSearch(m_startNode, m_goalNode, SearchMethod::Overlay);
+                    }
+                    ImGui::SameLine();
+                    ImGui::Text("%d levels", int(planner.numLevels()));
                 }
+                if (m_searchResult.settled > 0)
+                {
+                    if (m_searchResult.found())
+                    {
+                        ImGui::Text("Travel Time: %.1f min", m_searchResult.cost / 60.0);
+                        ImGui::Text("Length: %.2f km", m_searchResult.length / 1000.0);
+                    }
+                    else
+                    {
+                        ImGui::Text("No Path Found");
+                    }
+                    ImGui::Text("Settled: %d nodes (%.2f ms)", int(m_searchResult.settled), m_searchResult.millis);
+                    ImGui::Text("   Forward: %d, Backward: %d", int(m_searchResult.settled - m_searchResult.settledBackward), int(m_searchResult.settledBackward));
 
+                    if (!m_activeLandmarks.empty())
+                    {
+                        std::string used;
+                        for (uint32_t l : m_activeLandmarks) { used += (used.empty() ? "" : ", ") + std::to_string(l); }
+                        ImGui::Text("Landmarks Used: %s", used.c_str());
+
+                        const double saved = 100.0 * (1.0 - double(m_searchResult.settled) / double(std::max<size_t>(1, m_baselineSettled)));
+                        ImGui::Text("   Saved vs Straight Line: %.1f%% (%d nodes)", saved, int(m_baselineSettled));
+                    }
+                }
+
+                ImGui::EndTabItem();
+            }
+
+            if (ImGui::BeginTabItem("Tags"))
+            {
+                const WayTagDictionary& tags = m_mapData.getWayData().getTags();
+                size_t numWays = std::max<size_t>(1, m_mapData.getWays().size());
+                ImGui::Text("Tag Bytes / Way: %.1f", double(sizeof(Way::tags)) + double(tags.getMemoryBytes()) / double(numWays));
+                for (size_t f = 0; f < WayTag::Count; f++)
+                {
+                    ImGui::Text("%14s: %d values", WayTag::getName(WayTag::Field(f)), int(tags.getField(WayTag::Field(f)).size()));
+                }
+                ImGui::EndTabItem();
+            }
+
+            if (ImGui::BeginTabItem("Filter"))
+            {
+                imguiFilter();
+                ImGui::EndTabItem();
+            }
+
+            if (ImGui::BeginTabItem("Speeds"))
+            {
+                imguiSpeeds();
                 ImGui::EndTabItem();
             }
 
@@ -271,7 +635,8 @@ public:
             {
                 for (auto& tc : m_colorOptions)
                 {
-                    if (ImGui::ColorEdit3(tc.type.c_str(), &tc.color.x))
+                    // while loading, the final vertex arrays are built with the current colors anyway
+                    if (ImGui::ColorEdit3(tc.type.c_str(), &tc.color.x) && !m_loadingMap)
                     {
                         m_wayLines.clear();
                         loadWayLines();
@@ -286,13 +651,170 @@ public:
         ImGui::End();
     }
 
-    void doSearch(int startNodeIndex, int goalNodeIndex)
+    // speed edits re-weight the search graphs when the field is left, not on every keystroke,
+    // and the last search is repeated so the route follows the new weights. while loading the
+    // fields are disabled, the speed table shown belongs to the placeholder map that is replaced
+    void imguiSpeeds()
+    {
+        SpeedTable& speeds = m_mapData.getSpeedTable();
+        if (m_highwaySpeeds.empty())
+        {
+            m_highwaySpeeds.assign(speeds.getHighwaySpeeds().begin(), speeds.getHighwaySpeeds().end());
+            std::sort(m_highwaySpeeds.begin(), m_highwaySpeeds.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+        }
+
+        bool changed = false;
+        ImGui::BeginDisabled(m_loadingMap != nullptr);
+        ImGui::Text("Car Speeds by Highway (km/h)");
+        for (auto& [highway, kmh] : m_highwaySpeeds)
+        {
+            ImGui::SetNextItemWidth(120);
+            ImGui::InputFloat(highway.c_str(), &kmh, 5.0f, 10.0f, "%.0f");
+            if (ImGui::IsItemDeactivatedAfterEdit())
+            {
+                kmh = std::max(kmh, 1.0f);
+                speeds.setHighwaySpeed(highway, kmh);
+                changed = true;
+            }
+        }
+
+        float bike = speeds.getBikeSpeed(), foot = speeds.getFootSpeed();
+        ImGui::SetNextItemWidth(120);
+        ImGui::InputFloat("Bike", &bike, 1.0f, 5.0f, "%.0f");
+        if (ImGui::IsItemDeactivatedAfterEdit()) { speeds.setBikeSpeed(std::max(bike, 1.0f)); changed = true; }
+        ImGui::SetNextItemWidth(120);
+        ImGui::InputFloat("Foot", &foot, 1.0f, 5.0f, "%.0f");
+        if (ImGui::IsItemDeactivatedAfterEdit()) { speeds.setFootSpeed(std::max(foot, 1.0f)); changed = true; }
+        ImGui::EndDisabled();
+
+        if (changed && !m_loadingMap)
+        {
+            stopPreparing();
+            Timer timer;
+            m_mapData.updateSpeeds();
+            m_speedUpdateMillis = timer.getElapsedMillis();
+
+            // the hierarchies and landmarks of the modes whose weights changed were dropped, the worker builds them again
+            for (size_t m = 0; m < NumTravelModes; m++)
+            {
+                if (m_mapData.getLandmarks(TravelMode(m)).empty()) { m_prepared[m][size_t(Prepared::Landmarks)] = false; }
+                if (m_mapData.getHierarchy(TravelMode(m)).empty()) { m_prepared[m][size_t(Prepared::Hierarchy)] = false; }
+            }
+
+            // until then the overlay finds the same routes, or the bidirectional search if it isn't ready either
+            SearchMethod method = m_lastSearchMethod;
+            if (method == SearchMethod::Hierarchy && !isPrepared(Prepared::Hierarchy)) { method = SearchMethod::Overlay; }
+            if (method == SearchMethod::Overlay && !isPrepared(Prepared::Overlay))     { method = SearchMethod::Bidirectional; }
+            if (m_searchResult.settled > 0) { doSearch(m_startNode, m_goalNode, method); }
+        }
+        if (m_speedUpdateMillis > 0)
+        {
+            ImGui::Text("Search Graphs Updated in %.0f ms", m_speedUpdateMillis);
+        }
+    }
+
+    void imguiFilter()
+    {
+        auto fieldName = [](void*, int i) { return WayTag::getName(WayTag::Field(i)); };
+
+        for (int i = 0; i < 3; i++)
+        {
+            FilterCondition& c = m_filterConditions[i];
+            ImGui::PushID(i);
+            ImGui::Checkbox("##enabled", &c.enabled);
+            ImGui::SameLine(); ImGui::SetNextItemWidth(120);
+            ImGui::Combo("##field", &c.field, fieldName, nullptr, WayTag::Count);
+            ImGui::SameLine(); ImGui::SetNextItemWidth(50);
+            int op = c.negate ? 1 : 0;
+            if (ImGui::Combo("##op", &op, "==\0!=\0")) { c.negate = (op == 1); }
+            ImGui::SameLine(); ImGui::SetNextItemWidth(150);
+            ImGui::InputText("##value", c.value, sizeof(c.value));
+            ImGui::PopID();
+        }
+
+        ImGui::Combo("Mode", &m_filterMode, "Highlight Matches\0Hide Matches\0Show Only Matches\0");
+        ImGui::ColorEdit3("Highlight", &m_filterColor.x);
+
+        if (ImGui::Button("Apply Filter") && !m_loadingMap) { applyFilter(); }
+        ImGui::SameLine();
+        if (ImGui::Button("Clear Filter") && m_filterActive)
+        {
+            m_filterActive = false;
+            m_wayLines.clear();
+            loadWayLines();
+        }
+
+        if (m_filterActive)
+        {
+            ImGui::Text("Matches: %d ways (%.2f ms)", int(m_filterMatches.count()), m_filterMillis);
+        }
+    }
+
+    void imguiLoadingProgress()
+    {
+        double megabytes = double(m_loadProgress.bytesParsed) / (1024.0 * 1024.0);
+        double totalMegabytes = double(m_loadProgress.totalBytes) / (1024.0 * 1024.0);
+        float fraction = totalMegabytes > 0 ? float(megabytes / totalMegabytes) : 0.0f;
+        double waysPerSec = double(m_loadProgress.waysParsed) / std::max(m_loadTimer.getElapsedSec(), 1e-9);
+
+        char overlay[64];
+        std::snprintf(overlay, sizeof(overlay), "%.1f / %.1f MB", megabytes, totalMegabytes);
+
+        ImGui::Text("Loading: %s", m_loadProgress.stage.load());
+        ImGui::ProgressBar(fraction, ImVec2(-1, 0), overlay);
+        ImGui::Text("Ways Parsed: %d (%.0f ways/s)", int(m_loadProgress.waysParsed), waysPerSec);
+        ImGui::Separator();
+    }
+
+    enum class SearchMethod { OneWay, Bidirectional, Hierarchy, Overlay };
+    enum class Heuristic { None, StraightLine, Landmarks };
+
+    SearchMethod        m_lastSearchMethod = SearchMethod::OneWay;
+
+    void doSearch(int startNodeIndex, int goalNodeIndex, SearchMethod method)
     {
         if (startNodeIndex == -1 || goalNodeIndex == -1) { return; }
 
-        Node& startNode = m_mapData.getNodes()[startNodeIndex];
-        Node& goalNode  = m_mapData.getNodes()[goalNodeIndex];
+        const Graph& graph = m_mapData.getGraph();
+        const DirectedGraph& directed = m_mapData.getDirectedGraph(TravelMode(m_travelMode));
+        const uint32_t start = uint32_t(startNodeIndex), goal = uint32_t(goalNodeIndex);
+        m_lastSearchMethod = method;
+        const bool useHeuristic = m_heuristic != int(Heuristic::None);
+        const Landmarks& landmarks = m_mapData.getLandmarks(TravelMode(m_travelMode));
+        m_activeLandmarks.clear();
 
-        // do rest of search here
+        // landmark searches also run the straight line search, to show how much of its search space they save
+        if (m_heuristic == int(Heuristic::Landmarks) && isPrepared(Prepared::Landmarks) && !landmarks.empty() && (method == SearchMethod::OneWay || method == SearchMethod::Bidirectional))
+        {
+            m_activeLandmarks = landmarks.selectActive(start, goal, Landmarks::DefaultActive);
+            const LandmarkHeuristic toGoal(landmarks, m_activeLandmarks, goal);
+            if (method == SearchMethod::OneWay)
+            {
+                m_baselineSettled = m_search.search(graph, directed, start, goal).settled;
+                m_searchResult = m_search.searchWith(graph, directed, start, goal, toGoal);
+            }
+            else
+            {
+                const LandmarkHeuristic fromStart(landmarks, m_activeLandmarks, start, true);
+                m_baselineSettled = m_bidirectionalSearch.search(graph, directed, start, goal).settled;
+                m_searchResult = m_bidirectionalSearch.searchWith(graph, directed, start, goal, toGoal, fromStart);
+            }
+        }
+        else
+        {
+            switch (method)
+            {
+                case SearchMethod::OneWay:        m_searchResult = m_search.search(graph, directed, start, goal, useHeuristic); break;
+                case SearchMethod::Bidirectional: m_searchResult = m_bidirectionalSearch.search(graph, directed, start, goal, useHeuristic); break;
+                case SearchMethod::Hierarchy:     m_searchResult = m_mapData.getHierarchy(TravelMode(m_travelMode)).search(graph, start, goal); break;
+                case SearchMethod::Overlay:       m_searchResult = m_mapData.getRoutePlanner(TravelMode(m_travelMode)).search(graph, directed, start, goal); break;
+            }
+        }
+
+        m_routeLines.clear();
+        for (uint32_t n : m_searchResult.path)
+        {
+            m_routeLines.append(sf::Vertex{ graph.position(n), sf::Color(0, 160, 255) });
+        }
     }
 };
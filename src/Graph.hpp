@@ -0,0 +1,356 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <string>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+// the road network as a compressed sparse row graph
+//
+// the edges of node n are [beginEdge(n), endEdge(n)) in flat parallel arrays: the 32 bit index
+// of the target node, the length and travel time of the edge, and the way it belongs to. the
+// positions are one more array per node. expanding a node in a search reads two offsets and one
+// contiguous run of targets and weights, with no per node allocations
+//
+// node and edge indices are 32 bits everywhere, which caps a map at 4 billion edges but halves
+// the index bandwidth of every expansion compared to 64 bit offsets
+class Graph
+{
+public:
+
+    // a position in 1e-7 degree steps, the precision osm itself stores coordinates with
+    struct FixedPoint
+    {
+        int32_t x = 0;
+        int32_t y = 0;
+    };
+
+    static constexpr double FixedPointScale = 1e7;
+
+    // set in the way of an edge that runs from a later vertex of its way to an earlier one
+    static constexpr uint32_t AgainstWay = 1u << 31;
+
+    // positions are longitude and negated latitude in degrees, see Node
+    static constexpr double MetersPerDegree = 6371008.8 * 3.14159265358979323846 / 180.0;
+
+private:
+
+    std::vector<uint32_t>       m_offsets{ 0 };     // numNodes + 1, edges of node n start at m_offsets[n]
+    std::vector<uint32_t>       m_targets;
+    std::vector<uint32_t>       m_edgeWays;         // index of the way of each edge, with the AgainstWay bit
+    std::vector<float>          m_lengths;          // length of each edge in meters
+    std::vector<float>          m_travelTimes;      // travel time of each edge in seconds, see computeTravelTimes()
+    std::vector<sf::Vector2f>   m_positions;
+    std::vector<FixedPoint>     m_fixedPositions;   // optional, empty unless computeFixedPositions() was called
+    float                       m_minCosLatitude = 1.0f;    // east west scale of the node furthest from the equator
+
+public:
+
+    Graph() = default;
+
+    // links consecutive vertices of every way in both directions, the way vertices must already
+    // hold the index of their node. each node's edges are ordered by way, then by position
+    template <class Ways>
+    void build(const Ways& ways, std::vector<sf::Vector2f>&& positions)
+    {
+        const size_t numNodes = positions.size();
+
+        // count the degree of every node, then turn the counts into offsets
+        std::vector<uint32_t> offsets(numNodes + 1, 0);
+        for (const auto& way : ways)
+        {
+            for (size_t i = 0; i < way.nodes.size(); i++)
+            {
+                offsets[way.nodes[i].index + 1] += (i > 0) + (i + 1 < way.nodes.size());
+            }
+        }
+        uint64_t numEdges = 0;
+        for (size_t n = 0; n < numNodes; n++)
+        {
+            numEdges += offsets[n + 1];
+            offsets[n + 1] += offsets[n];
+        }
+        checkEdgeCount(numEdges);
+
+        std::vector<uint32_t> targets(offsets.back());
+        std::vector<uint32_t> edgeWays(offsets.back());
+        std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+        uint32_t w = 0;
+        for (const auto& way : ways)
+        {
+            for (size_t i = 0; i < way.nodes.size(); i++)
+            {
+                uint32_t& e = next[way.nodes[i].index];
+                if (i > 0)                      { edgeWays[e] = w | AgainstWay; targets[e++] = uint32_t(way.nodes[i - 1].index); }
+                if (i + 1 < way.nodes.size())   { edgeWays[e] = w;              targets[e++] = uint32_t(way.nodes[i + 1].index); }
+            }
+            w++;
+        }
+
+        assign(std::move(offsets), std::move(targets), std::move(edgeWays), std::move(positions));
+    }
+
+    // takes already built arrays, from the parallel node build or the map cache
+    void assign(std::vector<uint32_t>&& offsets, std::vector<uint32_t>&& targets, std::vector<uint32_t>&& edgeWays, std::vector<sf::Vector2f>&& positions)
+    {
+        m_offsets = std::move(offsets);
+        m_targets = std::move(targets);
+        m_edgeWays = std::move(edgeWays);
+        m_positions = std::move(positions);
+        m_fixedPositions.clear();
+        m_travelTimes.clear();
+        computeLengths();
+    }
+
+    // the travel time of every edge from the speed of its way, in meters per second
+    void computeTravelTimes(const std::vector<float>& waySpeeds)
+    {
+        m_travelTimes.resize(m_targets.size());
+        for (size_t e = 0; e < m_targets.size(); e++)
+        {
+            m_travelTimes[e] = m_lengths[e] / waySpeeds[m_edgeWays[e] & ~AgainstWay];
+        }
+    }
+
+    // gives the edges new way indices after the ways have been reordered
+    void remapWays(const std::vector<uint32_t>& wayRank)
+    {
+        for (uint32_t& way : m_edgeWays) { way = wayRank[way & ~AgainstWay] | (way & AgainstWay); }
+    }
+
+    // the largest number of edges 32 bit offsets can address
+    static void checkEdgeCount(uint64_t numEdges)
+    {
+        if (numEdges > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::length_error("Graph: " + std::to_string(numEdges) + " edges do not fit 32 bit edge offsets");
+        }
+    }
+
+    // rounds every position to a fixed point copy, for code that wants exact integer coordinates
+    // the float positions are kept, since rendering and the edge lengths use them
+    void computeFixedPositions()
+    {
+        m_fixedPositions.resize(m_positions.size());
+        for (size_t n = 0; n < m_positions.size(); n++)
+        {
+            m_fixedPositions[n] = { toFixed(m_positions[n].x), toFixed(m_positions[n].y) };
+        }
+    }
+
+    bool hasFixedPositions() const
+    {
+        return !m_positions.empty() && m_fixedPositions.size() == m_positions.size();
+    }
+
+    const FixedPoint& fixedPosition(size_t node) const
+    {
+        return m_fixedPositions[node];
+    }
+
+    static int32_t toFixed(float value)
+    {
+        return int32_t(std::lround(double(value) * FixedPointScale));
+    }
+
+    static float fromFixed(int32_t value)
+    {
+        return float(double(value) / FixedPointScale);
+    }
+
+    // moves node order[i] to index i, every edge keeps its position among the edges of its node
+    // returns the new index of every old node
+    std::vector<uint32_t> renumber(const std::vector<uint32_t>& order)
+    {
+        const size_t numNodes = m_positions.size();
+        std::vector<uint32_t> rank(numNodes);
+        for (size_t n = 0; n < numNodes; n++) { rank[order[n]] = uint32_t(n); }
+
+        std::vector<uint32_t> offsets(numNodes + 1, 0);
+        std::vector<uint32_t> targets(m_targets.size());
+        std::vector<uint32_t> edgeWays(m_edgeWays.size());
+        std::vector<float> lengths(m_lengths.size());
+        std::vector<float> travelTimes(m_travelTimes.size());
+        std::vector<sf::Vector2f> positions(numNodes);
+        for (size_t n = 0; n < numNodes; n++)
+        {
+            const uint32_t old = order[n];
+            uint32_t e = offsets[n];
+            for (uint32_t oldEdge = m_offsets[old]; oldEdge < m_offsets[old + 1]; oldEdge++, e++)
+            {
+                targets[e] = rank[m_targets[oldEdge]];
+                edgeWays[e] = m_edgeWays[oldEdge];
+                lengths[e] = m_lengths[oldEdge];
+                if (!travelTimes.empty()) { travelTimes[e] = m_travelTimes[oldEdge]; }
+            }
+            offsets[n + 1] = e;
+            positions[n] = m_positions[old];
+        }
+
+        m_offsets = std::move(offsets);
+        m_targets = std::move(targets);
+        m_edgeWays = std::move(edgeWays);
+        m_lengths = std::move(lengths);
+        m_travelTimes = std::move(travelTimes);
+        m_positions = std::move(positions);
+        if (!m_fixedPositions.empty()) { computeFixedPositions(); }
+        return rank;
+    }
+
+    size_t numNodes() const
+    {
+        return m_positions.size();
+    }
+
+    size_t numEdges() const
+    {
+        return m_targets.size();
+    }
+
+    uint32_t beginEdge(size_t node) const
+    {
+        return m_offsets[node];
+    }
+
+    uint32_t endEdge(size_t node) const
+    {
+        return m_offsets[node + 1];
+    }
+
+    size_t degree(size_t node) const
+    {
+        return size_t(m_offsets[node + 1] - m_offsets[node]);
+    }
+
+    uint32_t target(uint32_t edge) const
+    {
+        return m_targets[edge];
+    }
+
+    // length in meters
+    float length(uint32_t edge) const
+    {
+        return m_lengths[edge];
+    }
+
+    // travel time in seconds, only valid once hasTravelTimes()
+    float travelTime(uint32_t edge) const
+    {
+        return m_travelTimes[edge];
+    }
+
+    bool hasTravelTimes() const
+    {
+        return m_travelTimes.size() == m_targets.size();
+    }
+
+    // the index of the way the edge was built from
+    uint32_t edgeWay(uint32_t edge) const
+    {
+        return m_edgeWays[edge] & ~AgainstWay;
+    }
+
+    // whether the edge runs against the vertex order of its way, which matters for one way streets
+    bool isAgainstWay(uint32_t edge) const
+    {
+        return (m_edgeWays[edge] & AgainstWay) != 0;
+    }
+
+    // the target node of every edge leaving node
+    std::span<const uint32_t> neighbors(size_t node) const
+    {
+        return std::span<const uint32_t>(m_targets.data() + m_offsets[node], degree(node));
+    }
+
+    const sf::Vector2f& position(size_t node) const
+    {
+        return m_positions[node];
+    }
+
+    const std::vector<sf::Vector2f>& getPositions() const
+    {
+        return m_positions;
+    }
+
+    const std::vector<uint32_t>& getOffsets() const
+    {
+        return m_offsets;
+    }
+
+    const std::vector<uint32_t>& getTargets() const
+    {
+        return m_targets;
+    }
+
+    const std::vector<uint32_t>& getEdgeWays() const
+    {
+        return m_edgeWays;
+    }
+
+    const std::vector<float>& getLengths() const
+    {
+        return m_lengths;
+    }
+
+    const std::vector<float>& getTravelTimes() const
+    {
+        return m_travelTimes;
+    }
+
+    // no edge of the graph is shorter than its straight line at this east west scale, which makes
+    // it the scale of lower bounds on the length of any path, see StraightLineHeuristic
+    float getMinCosLatitude() const
+    {
+        return m_minCosLatitude;
+    }
+
+    // the distance between two positions in meters, on a sphere locally flattened at their mean latitude
+    static float distanceMeters(const sf::Vector2f& a, const sf::Vector2f& b)
+    {
+        double cosLat = std::cos(-0.5 * (double(a.y) + double(b.y)) * (3.14159265358979323846 / 180.0));
+        double dx = (double(b.x) - double(a.x)) * cosLat;
+        double dy = double(b.y) - double(a.y);
+        return float(std::sqrt(dx * dx + dy * dy) * MetersPerDegree);
+    }
+
+    size_t getMemoryBytes() const
+    {
+        return (m_offsets.capacity() + m_targets.capacity() + m_edgeWays.capacity()) * sizeof(uint32_t)
+             + (m_lengths.capacity() + m_travelTimes.capacity()) * sizeof(float) + m_positions.capacity() * sizeof(sf::Vector2f)
+             + m_fixedPositions.capacity() * sizeof(FixedPoint);
+    }
+
+private:
+
+    // the east west scale of every node is computed once, an edge uses the mean of its two ends,
+    // which for edges of a road network is the same as distanceMeters() to well below a millimeter
+    void computeLengths()
+    {
+        std::vector<float> cosLat(m_positions.size());
+        m_minCosLatitude = 1.0f;
+        for (size_t n = 0; n < m_positions.size(); n++)
+        {
+            cosLat[n] = float(std::cos(-double(m_positions[n].y) * (3.14159265358979323846 / 180.0)));
+            m_minCosLatitude = std::min(m_minCosLatitude, cosLat[n]);
+        }
+
+        m_lengths.resize(m_targets.size());
+        for (size_t n = 0; n + 1 < m_offsets.size(); n++)
+        {
+            for (uint32_t e = m_offsets[n]; e < m_offsets[n + 1]; e++)
+            {
+                const uint32_t t = m_targets[e];
+                double dx = (double(m_positions[t].x) - double(m_positions[n].x)) * 0.5 * (double(cosLat[n]) + double(cosLat[t]));
+                double dy = double(m_positions[t].y) - double(m_positions[n].y);
+                m_lengths[e] = float(std::sqrt(dx * dx + dy * dy) * MetersPerDegree);
+            }
+        }
+    }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+// maps positions inside a bounding box to their distance along a hilbert curve through it
+// sorting by this key puts points that are close on the map close together in memory, and
+// unlike a morton order the curve never jumps across the box between consecutive cells
+class HilbertCurve
+{
+    static constexpr uint32_t Bits = 16;            // 65536 x 65536 cells, the key fits 32 bits
+
+    sf::Vector2f m_min;
+    sf::Vector2f m_scale;
+
+public:
+
+    explicit HilbertCurve(const std::vector<sf::Vector2f>& positions)
+    {
+        if (positions.empty()) { return; }
+
+        sf::Vector2f max = positions[0];
+        m_min = positions[0];
+        for (const sf::Vector2f& p : positions)
+        {
+            m_min.x = std::min(m_min.x, p.x); m_min.y = std::min(m_min.y, p.y);
+            max.x = std::max(max.x, p.x);     max.y = std::max(max.y, p.y);
+        }
+
+        const float cells = float((1u << Bits) - 1);
+        m_scale.x = max.x > m_min.x ? cells / (max.x - m_min.x) : 0.0f;
+        m_scale.y = max.y > m_min.y ? cells / (max.y - m_min.y) : 0.0f;
+    }
+
+    uint32_t key(const sf::Vector2f& p) const
+    {
+        const uint32_t maxCell = (1u << Bits) - 1;
+        uint32_t x = std::min(maxCell, uint32_t(std::max(0.0f, (p.x - m_min.x) * m_scale.x)));
+        uint32_t y = std::min(maxCell, uint32_t(std::max(0.0f, (p.y - m_min.y) * m_scale.y)));
+        return index(x, y);
+    }
+
+    // the classic iterative xy to distance conversion, rotating the quadrant at every level
+    static uint32_t index(uint32_t x, uint32_t y)
+    {
+        uint32_t d = 0;
+        for (uint32_t s = 1u << (Bits - 1); s > 0; s >>= 1)
+        {
+            uint32_t rx = (x & s) ? 1 : 0;
+            uint32_t ry = (y & s) ? 1 : 0;
+            d += s * s * ((3 * rx) ^ ry);
+
+            if (ry == 0)
+            {
+                if (rx == 1) { x = s - 1 - (x & (s - 1)); y = s - 1 - (y & (s - 1)); }
+                std::swap(x, y);
+            }
+        }
+        return d;
+    }
+};
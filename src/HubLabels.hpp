@@ -0,0 +1,405 @@
+#pragma once
+
+#include "ContractionHierarchy.hpp"
+#include "MappedFile.hpp"
+#include "ParallelFor.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+    #include <emmintrin.h>
+    #define NLMAP_SSE2 1
+#endif
+
+// hub labels over the contraction hierarchy of one travel mode, a distance oracle without any search
+//
+// the forward label of a node lists the higher ranked nodes its upward search reaches (its hubs)
+// with the travel time to each, the backward label the same for the reverse upward search. the
+// highest ranked node of a shortest path is in the forward label of its start and the backward label
+// of its goal, so the travel time between two nodes is the smallest sum over the hubs their labels share
+//
+// a node's label is merged from the labels of its upward neighbors, so the labels are built from the
+// top of the hierarchy down, all nodes whose neighbors are done in parallel. a hub is then dropped
+// if the labels built so far already know a shorter way to it, which keeps only exact travel times
+// and removes most of the upward search space
+//
+// the labels are stored flat, sorted by hub and padded to blocks of four, so a query is a merge of
+// two short arrays that SSE2 compares four by four hubs at a time. saved labels are memory mapped
+// rather than read, so a large label file costs no load time and only the pages queries touch
+class HubLabels
+{
+public:
+
+    static constexpr uint32_t Padding = UINT32_MAX;         // the hub of the entries filling up a label's last block
+    static constexpr size_t   BlockSize = 4;
+
+private:
+
+    // one direction's labels, hubs[offsets[n]] to hubs[offsets[n + 1]] is the label of node n
+    struct Labels
+    {
+        const uint64_t* offsets = nullptr;
+        const uint32_t* hubs = nullptr;
+        const float*    dists = nullptr;
+    };
+
+    Labels                      m_labels[2];                // forward, backward
+    size_t                      m_numNodes = 0;
+    uint64_t                    m_numEntries = 0;           // both directions, without the padding
+
+    // the arrays the labels point into, either built here or mapped from a file
+    std::vector<uint64_t>       m_offsets[2];
+    std::vector<uint32_t>       m_hubs[2];
+    std::vector<float>          m_dists[2];
+    std::unique_ptr<MappedFile> m_file;
+
+public:
+
+    static constexpr char     Magic[8] = { 'N', 'L', 'H', 'L', 0, 0, 0, 0 };
+    static constexpr uint32_t Version = 1;
+
+    bool empty() const
+    {
+        return m_numNodes == 0;
+    }
+
+    size_t numNodes() const
+    {
+        return m_numNodes;
+    }
+
+    uint64_t numEntries() const
+    {
+        return m_numEntries;
+    }
+
+    double averageLabelSize() const
+    {
+        return m_numNodes > 0 ? double(m_numEntries) / double(2 * m_numNodes) : 0.0;
+    }
+
+    bool isMapped() const
+    {
+        return m_file != nullptr;
+    }
+
+    // the size of the label arrays, in memory or in the mapped file
+    size_t getLabelBytes() const
+    {
+        if (empty()) { return 0; }
+        size_t bytes = 0;
+        for (const Labels& labels : m_labels)
+        {
+            bytes += (m_numNodes + 1) * sizeof(uint64_t) + labels.offsets[m_numNodes] * (sizeof(uint32_t) + sizeof(float));
+        }
+        return bytes;
+    }
+
+    void clear()
+    {
+        *this = HubLabels();
+    }
+
+    // the travel time in seconds from start to goal, infinity if the goal can't be reached
+    float distance(uint32_t start, uint32_t goal) const
+    {
+        const Labels& f = m_labels[0];
+        const Labels& b = m_labels[1];
+        return intersect(f.hubs + f.offsets[start], f.dists + f.offsets[start], f.offsets[start + 1] - f.offsets[start],
+                         b.hubs + b.offsets[goal], b.dists + b.offsets[goal], b.offsets[goal + 1] - b.offsets[goal]);
+    }
+
+    // stops between levels once cancel is set, leaving the labels empty
+    void build(const ContractionHierarchy& hierarchy, size_t numThreads, const std::atomic<bool>* cancel = nullptr)
+    {
+        clear();
+        numThreads = std::max<size_t>(1, numThreads);
+        const size_t numNodes = hierarchy.numNodes();
+        if (numNodes == 0) { return; }
+
+        std::vector<uint32_t> byRank(numNodes);
+        for (uint32_t n = 0; n < numNodes; n++) { byRank[hierarchy.rank(n)] = n; }
+
+        // a node's level is one more than that of its highest neighbor, the top nodes are level 0
+        std::vector<uint32_t> levels(numNodes, 0);
+        uint32_t numLevels = 0;
+        for (size_t r = numNodes; r-- > 0;)
+        {
+            const uint32_t n = byRank[r];
+            uint32_t level = 0;
+            for (const ContractionHierarchy::Arc* a = hierarchy.beginUp(n); a != hierarchy.endUp(n); a++)     { level = std::max(level, levels[a->node] + 1); }
+            for (const ContractionHierarchy::Arc* a = hierarchy.beginDown(n); a != hierarchy.endDown(n); a++) { level = std::max(level, levels[a->node] + 1); }
+            levels[n] = level;
+            numLevels = std::max(numLevels, level + 1);
+        }
+
+        std::vector<uint32_t> levelOffsets(numLevels + 1, 0);
+        for (uint32_t level : levels) { levelOffsets[level + 1]++; }
+        for (uint32_t l = 0; l < numLevels; l++) { levelOffsets[l + 1] += levelOffsets[l]; }
+        std::vector<uint32_t> byLevel(numNodes);
+        {
+            std::vector<uint32_t> next(levelOffsets.begin(), levelOffsets.end() - 1);
+            for (uint32_t n = 0; n < numNodes; n++) { byLevel[next[levels[n]]++] = n; }
+        }
+
+        Builder builder(hierarchy, byRank, numThreads);
+        for (uint32_t l = 0; l < numLevels; l++)
+        {
+            if (cancel && *cancel) { return; }
+            parallelFor(numThreads, levelOffsets[l + 1] - levelOffsets[l], [&](size_t t, size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    const uint32_t n = byLevel[levelOffsets[l] + i];
+                    builder.makeLabel(0, n, t);
+                    builder.makeLabel(1, n, t);
+                }
+            }, 64);
+        }
+
+        // each working label is freed as soon as it is copied into the flat arrays
+        m_numNodes = numNodes;
+        for (int side = 0; side < 2; side++)
+        {
+            size_t padded = 0;
+            for (const std::vector<Entry>& label : builder.labels[side]) { padded += (label.size() + BlockSize - 1) / BlockSize * BlockSize; }
+            m_hubs[side].reserve(padded);
+            m_dists[side].reserve(padded);
+            m_offsets[side].reserve(numNodes + 1);
+            m_offsets[side].push_back(0);
+            for (uint32_t n = 0; n < numNodes; n++)
+            {
+                std::vector<Entry>& label = builder.labels[side][n];
+                m_numEntries += label.size();
+                for (const Entry& e : label)
+                {
+                    m_hubs[side].push_back(e.hub);
+                    m_dists[side].push_back(e.dist);
+                }
+                while (m_hubs[side].size() % BlockSize != 0)
+                {
+                    m_hubs[side].push_back(Padding);
+                    m_dists[side].push_back(std::numeric_limits<float>::infinity());
+                }
+                m_offsets[side].push_back(m_hubs[side].size());
+                std::vector<Entry>().swap(label);
+            }
+            m_labels[side] = { m_offsets[side].data(), m_hubs[side].data(), m_dists[side].data() };
+        }
+    }
+
+    // the labels are only valid for the exact directed graph their hierarchy was built from, which
+    // is identified by graphHash, see MapCache::hashDirectedGraph
+    bool save(const std::string& filename, uint64_t graphHash) const
+    {
+        if (empty()) { return false; }
+
+        Header header;
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version    = Version;
+        header.graphHash  = graphHash;
+        header.numNodes   = m_numNodes;
+        header.numEntries = m_numEntries;
+        header.numForward = m_labels[0].offsets[m_numNodes];
+        header.numBackward = m_labels[1].offsets[m_numNodes];
+
+        return writeFileAtomically(filename, [&](std::ofstream& out)
+        {
+            out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            for (const Labels& labels : m_labels)
+            {
+                const uint64_t count = labels.offsets[m_numNodes];
+                writeArray(out, labels.offsets, m_numNodes + 1);
+                writeArray(out, labels.hubs, count);
+                writeArray(out, labels.dists, count);
+            }
+        });
+    }
+
+    // maps the file instead of reading it, the labels then point into the mapping
+    // returns false if the file is missing, damaged, or was built from a different graph
+    bool load(const std::string& filename, uint64_t graphHash, size_t numNodes)
+    {
+        auto file = std::make_unique<MappedFile>(filename);
+        if (!file->isOpen() || file->size() < sizeof(Header)) { return false; }
+
+        Header header;
+        std::memcpy(&header, file->data(), sizeof(Header));
+        if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0) { return false; }
+        if (header.version != Version || header.graphHash != graphHash || header.numNodes != numNodes || numNodes == 0) { return false; }
+
+        const uint64_t counts[2] = { header.numForward, header.numBackward };
+        const uint64_t expected = sizeof(Header) + 2 * (header.numNodes + 1) * sizeof(uint64_t)
+                                + (counts[0] + counts[1]) * (sizeof(uint32_t) + sizeof(float));
+        if (file->size() != expected) { return false; }
+
+        HubLabels loaded;
+        const char* p = file->data() + sizeof(Header);
+        for (int side = 0; side < 2; side++)
+        {
+            Labels& labels = loaded.m_labels[side];
+            labels.offsets = reinterpret_cast<const uint64_t*>(p);
+            p += (numNodes + 1) * sizeof(uint64_t);
+            labels.hubs = reinterpret_cast<const uint32_t*>(p);
+            p += counts[side] * sizeof(uint32_t);
+            labels.dists = reinterpret_cast<const float*>(p);
+            p += counts[side] * sizeof(float);
+
+            // hubs are only ever compared, never used as indexes, so the offsets are all a query relies on
+            if (labels.offsets[0] != 0 || labels.offsets[numNodes] != counts[side]) { return false; }
+            for (size_t n = 0; n < numNodes; n++)
+            {
+                if (labels.offsets[n] > labels.offsets[n + 1] || labels.offsets[n + 1] % BlockSize != 0) { return false; }
+            }
+        }
+
+        loaded.m_numNodes = numNodes;
+        loaded.m_numEntries = header.numEntries;
+        loaded.m_file = std::move(file);
+        *this = std::move(loaded);
+        return true;
+    }
+
+private:
+
+    struct Entry
+    {
+        uint32_t    hub;            // the rank of the hub
+        float       dist;
+    };
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t padding = 0;
+        uint64_t graphHash;
+        uint64_t numNodes;
+        uint64_t numEntries;
+        uint64_t numForward;        // label array lengths, with padding
+        uint64_t numBackward;
+    };
+
+    template <class T>
+    static void writeArray(std::ofstream& out, const T* values, size_t count)
+    {
+        out.write(reinterpret_cast<const char*>(values), std::streamsize(count * sizeof(T)));
+    }
+
+    // the smallest da + db over the hubs both labels share, the counts are multiples of the block size
+    // a padding entry meets only another padding entry, whose sum is infinite
+    static float intersect(const uint32_t* hubsA, const float* distsA, size_t countA, const uint32_t* hubsB, const float* distsB, size_t countB)
+    {
+        float best = std::numeric_limits<float>::infinity();
+        size_t i = 0, j = 0;
+
+#ifdef NLMAP_SSE2
+        // every hub of a block of a against every hub of a block of b, by comparing a with the four
+        // rotations of b. the block whose last hub is smaller can't share a hub with later blocks
+        const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        __m128 min = inf;
+        while (i < countA && j < countB)
+        {
+            const __m128i ha = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hubsA + i));
+            const __m128  da = _mm_loadu_ps(distsA + i);
+            __m128i hb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hubsB + j));
+            __m128  db = _mm_loadu_ps(distsB + j);
+            for (int r = 0; r < 4; r++)
+            {
+                const __m128 equal = _mm_castsi128_ps(_mm_cmpeq_epi32(ha, hb));
+                const __m128 sum = _mm_add_ps(da, db);
+                min = _mm_min_ps(min, _mm_or_ps(_mm_and_ps(equal, sum), _mm_andnot_ps(equal, inf)));
+                hb = _mm_shuffle_epi32(hb, _MM_SHUFFLE(0, 3, 2, 1));
+                db = _mm_shuffle_ps(db, db, _MM_SHUFFLE(0, 3, 2, 1));
+            }
+
+            const uint32_t lastA = hubsA[i + 3], lastB = hubsB[j + 3];
+            if (lastA <= lastB) { i += BlockSize; }
+            if (lastB <= lastA) { j += BlockSize; }
+        }
+        min = _mm_min_ps(min, _mm_shuffle_ps(min, min, _MM_SHUFFLE(1, 0, 3, 2)));
+        min = _mm_min_ps(min, _mm_shuffle_ps(min, min, _MM_SHUFFLE(2, 3, 0, 1)));
+        best = _mm_cvtss_f32(min);
+#endif
+
+        while (i < countA && j < countB)
+        {
+            if (hubsA[i] < hubsB[j])      { i++; }
+            else if (hubsB[j] < hubsA[i]) { j++; }
+            else
+            {
+                best = std::min(best, distsA[i] + distsB[j]);
+                i++;
+                j++;
+            }
+        }
+        return best;
+    }
+
+    // the working labels, and per thread a table of the hubs of the label being made
+    struct Builder
+    {
+        const ContractionHierarchy&         hierarchy;
+        const std::vector<uint32_t>&        byRank;
+        std::vector<std::vector<Entry>>     labels[2];
+        std::vector<std::vector<float>>     hubDists;       // per thread, infinity for hubs not in the label
+        std::vector<std::vector<Entry>>     candidates;     // per thread
+
+        Builder(const ContractionHierarchy& hierarchy, const std::vector<uint32_t>& byRank, size_t numThreads)
+            : hierarchy(hierarchy)
+            , byRank(byRank)
+            , hubDists(numThreads, std::vector<float>(byRank.size(), std::numeric_limits<float>::infinity()))
+            , candidates(numThreads)
+        {
+            labels[0].resize(byRank.size());
+            labels[1].resize(byRank.size());
+        }
+
+        // side 0 makes the forward label from the upward edges, side 1 the backward label from the
+        // edges coming down, whose other ends all have their labels already
+        void makeLabel(int side, uint32_t node, size_t thread)
+        {
+            std::vector<Entry>& c = candidates[thread];
+            c.clear();
+            c.push_back({ hierarchy.rank(node), 0.0f });
+            const ContractionHierarchy::Arc* begin = side == 0 ? hierarchy.beginUp(node) : hierarchy.beginDown(node);
+            const ContractionHierarchy::Arc* end   = side == 0 ? hierarchy.endUp(node) : hierarchy.endDown(node);
+            for (const ContractionHierarchy::Arc* a = begin; a != end; a++)
+            {
+                for (const Entry& e : labels[side][a->node]) { c.push_back({ e.hub, e.dist + a->weight }); }
+            }
+
+            std::sort(c.begin(), c.end(), [](const Entry& a, const Entry& b) { return a.hub < b.hub || (a.hub == b.hub && a.dist < b.dist); });
+            c.erase(std::unique(c.begin(), c.end(), [](const Entry& a, const Entry& b) { return a.hub == b.hub; }), c.end());
+
+            // a hub is kept only if no other hub gives a shorter way to it. the way through a hub h goes
+            // through the hubs the label shares with the opposite label of h, found by looking each of
+            // those up in a table, which costs the size of h's label rather than both
+            std::vector<float>& dists = hubDists[thread];
+            for (const Entry& e : c) { dists[e.hub] = e.dist; }
+
+            std::vector<Entry>& label = labels[side][node];
+            for (const Entry& e : c)
+            {
+                bool keep = true;
+                for (const Entry& o : labels[1 - side][byRank[e.hub]])
+                {
+                    // slightly below, so float rounding between two equally short ways keeps the hub
+                    if (dists[o.hub] + o.dist < e.dist * (1.0f - 1e-5f)) { keep = false; break; }
+                }
+                if (keep) { label.push_back(e); }
+            }
+            for (const Entry& e : c) { dists[e.hub] = std::numeric_limits<float>::infinity(); }
+            label.shrink_to_fit();
+        }
+    };
+};
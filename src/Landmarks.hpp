@@ -0,0 +1,376 @@
+#pragma once
+
+#include "DirectedGraph.hpp"
+#include "BinaryHeap.hpp"
+#include "MappedFile.hpp"
+#include "ParallelFor.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// landmark lower bounds for A* (ALT: A*, landmarks and the triangle inequality)
+//
+// the travel times from a few landmark nodes to every node and from every node back to them are
+// precomputed. for a landmark L the triangle inequality gives two lower bounds on the travel time
+// from v to t: d(L,t) - d(L,v) and d(v,L) - d(t,L). a landmark behind the goal as seen from the
+// start bounds the remaining time much more tightly than a straight line across a river
+//
+// landmarks are picked either as far from each other as possible, or by the avoid method, which
+// places each landmark at the end of the region of a shortest path tree that the landmarks so far
+// bound worst. the table is stored by node, so a node's bounds are one block of memory, and only
+// nodes with legal edges have a row in it, since most nodes of a map are on buildings and areas
+class Landmarks
+{
+public:
+
+    enum class Selection { Farthest, Avoid };
+
+    static constexpr size_t DefaultCount = 16;
+    static constexpr size_t DefaultActive = 4;      // the landmarks a query uses, the best ones for its start and goal
+
+private:
+
+    static constexpr float    Unreachable = std::numeric_limits<float>::infinity();
+    static constexpr uint32_t NoRow = UINT32_MAX;
+
+    std::vector<uint32_t>   m_nodes;
+    std::vector<uint32_t>   m_rows;         // the table row of every node, NoRow for nodes without legal edges
+    std::vector<float>      m_distances;    // per row and landmark: from the landmark to the node, then from the node to the landmark
+
+    static constexpr char     Magic[8] = { 'N', 'L', 'A', 'L', 'T', 0, 0, 0 };
+    static constexpr uint32_t Version = 1;
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t numLandmarks;
+        uint64_t graphHash;
+        uint64_t numNodes;
+        uint64_t numRows;
+    };
+
+public:
+
+    bool empty() const
+    {
+        return m_nodes.empty();
+    }
+
+    size_t size() const
+    {
+        return m_nodes.size();
+    }
+
+    uint32_t node(size_t landmark) const
+    {
+        return m_nodes[landmark];
+    }
+
+    void clear()
+    {
+        m_nodes.clear();
+        m_rows.clear();
+        m_distances.clear();
+    }
+
+    size_t getMemoryBytes() const
+    {
+        return (m_nodes.capacity() + m_rows.capacity()) * sizeof(uint32_t) + m_distances.capacity() * sizeof(float);
+    }
+
+    float fromLandmark(uint32_t node, size_t landmark) const
+    {
+        const uint32_t row = m_rows[node];
+        return row == NoRow ? Unreachable : m_distances[(size_t(row) * m_nodes.size() + landmark) * 2];
+    }
+
+    float toLandmark(uint32_t node, size_t landmark) const
+    {
+        const uint32_t row = m_rows[node];
+        return row == NoRow ? Unreachable : m_distances[(size_t(row) * m_nodes.size() + landmark) * 2 + 1];
+    }
+
+    // a lower bound on the travel time from v to t using one landmark, bounds that involve an
+    // unreachable landmark say nothing and are 0
+    float lowerBound(uint32_t v, uint32_t t, size_t landmark) const
+    {
+        float bound = 0;
+        const float fromT = fromLandmark(t, landmark), fromV = fromLandmark(v, landmark);
+        const float toT = toLandmark(t, landmark), toV = toLandmark(v, landmark);
+        if (fromT != Unreachable && fromV != Unreachable) { bound = std::max(bound, fromT - fromV); }
+        if (toT != Unreachable && toV != Unreachable)     { bound = std::max(bound, toV - toT); }
+        return bound;
+    }
+
+    // the count landmarks with the largest bounds between start and goal, best first
+    std::vector<uint32_t> selectActive(uint32_t start, uint32_t goal, size_t count) const
+    {
+        std::vector<uint32_t> landmarks(m_nodes.size());
+        std::vector<float> bounds(m_nodes.size());
+        for (uint32_t l = 0; l < m_nodes.size(); l++)
+        {
+            landmarks[l] = l;
+            bounds[l] = lowerBound(start, goal, l);
+        }
+        std::stable_sort(landmarks.begin(), landmarks.end(), [&](uint32_t a, uint32_t b) { return bounds[a] > bounds[b]; });
+        landmarks.resize(std::min(count, landmarks.size()));
+        return landmarks;
+    }
+
+    // selects count landmarks among the nodes that have legal edges, and computes their tables
+    // stops between searches once cancel is set, leaving the tables empty
+    void build(const DirectedGraph& directed, size_t numNodes, size_t count, Selection selection, size_t numThreads, const std::atomic<bool>* cancel = nullptr)
+    {
+        auto cancelled = [&]() { return cancel && *cancel; };
+
+        clear();
+
+        // the selection runs one search after the other, each needs the landmarks before it
+        std::vector<std::vector<float>> from;
+        std::mt19937 rng(1);
+        std::vector<uint32_t> usable;
+        m_rows.assign(numNodes, NoRow);
+        uint32_t numRows = 0;
+        for (uint32_t n = 0; n < numNodes; n++)
+        {
+            if (directed.forward().beginEdge(n) < directed.forward().endEdge(n)) { usable.push_back(n); }
+            if (directed.forward().beginEdge(n) < directed.forward().endEdge(n) || directed.reverse().beginEdge(n) < directed.reverse().endEdge(n))
+            {
+                m_rows[n] = numRows++;
+            }
+        }
+        if (usable.empty()) { clear(); return; }
+
+        Search search;
+        for (size_t attempt = 0; m_nodes.size() < count && attempt < 2 * count; attempt++)
+        {
+            if (cancelled()) { clear(); return; }
+            const uint32_t root = usable[std::uniform_int_distribution<size_t>(0, usable.size() - 1)(rng)];
+            uint32_t landmark = selection == Selection::Avoid ? selectAvoid(directed, root, from, search) : UINT32_MAX;
+
+            // on a chain of shape points every branch of the root's tree may already hold a landmark
+            if (landmark == UINT32_MAX) { landmark = selectFarthest(directed, root, from, search); }
+            if (landmark == UINT32_MAX || std::find(m_nodes.begin(), m_nodes.end(), landmark) != m_nodes.end()) { continue; }
+
+            m_nodes.push_back(landmark);
+            from.emplace_back();
+            search.run(directed.forward(), landmark, from.back());
+        }
+
+        // the travel times to each landmark are independent searches over the reverse edges
+        std::vector<std::vector<float>> to(m_nodes.size());
+        std::vector<Search> searches(std::max<size_t>(1, numThreads));
+        parallelFor(numThreads, m_nodes.size(), [&](size_t t, size_t begin, size_t end)
+        {
+            for (size_t l = begin; l < end && !cancelled(); l++) { searches[t].run(directed.reverse(), m_nodes[l], to[l]); }
+        }, 1);
+        if (cancelled()) { clear(); return; }
+
+        const size_t k = m_nodes.size();
+        m_distances.resize(size_t(numRows) * k * 2);
+        for (size_t n = 0; n < numNodes; n++)
+        {
+            const uint32_t row = m_rows[n];
+            if (row == NoRow) { continue; }
+            for (size_t l = 0; l < k; l++)
+            {
+                m_distances[(size_t(row) * k + l) * 2] = from[l][n];
+                m_distances[(size_t(row) * k + l) * 2 + 1] = to[l][n];
+            }
+        }
+    }
+
+    // the tables are only valid for the exact directed graph they were computed on, which is
+    // identified by graphHash, see MapCache::hashDirectedGraph
+    bool save(const std::string& filename, uint64_t graphHash) const
+    {
+        Header header;
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version      = Version;
+        header.numLandmarks = uint32_t(m_nodes.size());
+        header.graphHash    = graphHash;
+        header.numNodes     = m_rows.size();
+        header.numRows      = m_nodes.empty() ? 0 : m_distances.size() / (2 * m_nodes.size());
+
+        return writeFileAtomically(filename, [&](std::ofstream& out)
+        {
+            out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            out.write(reinterpret_cast<const char*>(m_nodes.data()), std::streamsize(m_nodes.size() * sizeof(uint32_t)));
+            out.write(reinterpret_cast<const char*>(m_rows.data()), std::streamsize(m_rows.size() * sizeof(uint32_t)));
+            out.write(reinterpret_cast<const char*>(m_distances.data()), std::streamsize(m_distances.size() * sizeof(float)));
+        });
+    }
+
+    // returns false if the file is missing, damaged, or was computed on a different graph
+    bool load(const std::string& filename, uint64_t graphHash, size_t numNodes)
+    {
+        MappedFile file(filename);
+        if (!file.isOpen() || file.size() < sizeof(Header)) { return false; }
+
+        Header header;
+        std::memcpy(&header, file.data(), sizeof(Header));
+        if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0) { return false; }
+        if (header.version != Version || header.graphHash != graphHash || header.numNodes != numNodes) { return false; }
+
+        const size_t k = header.numLandmarks;
+        const size_t numRows = size_t(header.numRows);
+        if (numRows > numNodes || file.size() != sizeof(Header) + (k + numNodes) * sizeof(uint32_t) + numRows * k * 2 * sizeof(float)) { return false; }
+
+        const char* p = file.data() + sizeof(Header);
+        std::vector<uint32_t> nodes(k), rows(numNodes);
+        std::memcpy(nodes.data(), p, k * sizeof(uint32_t));
+        p += k * sizeof(uint32_t);
+        std::memcpy(rows.data(), p, numNodes * sizeof(uint32_t));
+        p += numNodes * sizeof(uint32_t);
+        for (uint32_t n : nodes) { if (n >= numNodes || rows[n] == NoRow) { return false; } }
+        for (uint32_t row : rows) { if (row != NoRow && row >= numRows) { return false; } }
+
+        m_nodes = std::move(nodes);
+        m_rows = std::move(rows);
+        m_distances.resize(numRows * k * 2);
+        std::memcpy(m_distances.data(), p, m_distances.size() * sizeof(float));
+        return true;
+    }
+
+private:
+
+    // one to all dijkstra, unreachable nodes are left at infinity
+    struct Search
+    {
+        BinaryHeap open;
+        std::vector<uint32_t> order;        // the nodes in the order they were settled
+        std::vector<uint32_t> parent;
+
+        void run(const DirectedGraph::Adjacency& edges, uint32_t source, std::vector<float>& dist)
+        {
+            const size_t numNodes = edges.getOffsets().size() - 1;
+            dist.assign(numNodes, Unreachable);
+            parent.assign(numNodes, UINT32_MAX);
+            order.clear();
+            open.resize(numNodes);
+
+            dist[source] = 0;
+            open.push(source, 0);
+            while (!open.empty())
+            {
+                const uint32_t n = open.pop();
+                order.push_back(n);
+                for (uint32_t e = edges.beginEdge(n); e < edges.endEdge(n); e++)
+                {
+                    const uint32_t t = edges.target(e);
+                    const float d = dist[n] + edges.weight(e);
+                    if (d >= dist[t]) { continue; }
+                    dist[t] = d;
+                    parent[t] = n;
+                    open.push(t, d);
+                }
+            }
+        }
+    };
+
+    // the node reachable from the root that is farthest from the landmarks so far. nodes no
+    // landmark reaches yet come first, the farthest of them from the root, so a map made of
+    // several disconnected parts gets landmarks in each
+    static uint32_t selectFarthest(const DirectedGraph& directed, uint32_t root, const std::vector<std::vector<float>>& from, Search& search)
+    {
+        std::vector<float> rootDist;
+        search.run(directed.forward(), root, rootDist);
+
+        uint32_t best = UINT32_MAX;
+        std::pair<bool, float> bestKey{ false, -1.0f };
+        for (uint32_t n : search.order)
+        {
+            float d = Unreachable;
+            for (const std::vector<float>& landmark : from) { d = std::min(d, landmark[n]); }
+
+            const std::pair<bool, float> key = d == Unreachable ? std::make_pair(true, rootDist[n]) : std::make_pair(false, d);
+            if (key > bestKey) { bestKey = key; best = n; }
+        }
+        return best;
+    }
+
+    // grows the shortest path tree of the root, and weighs each node by how much the landmarks so
+    // far underestimate its distance from the root. the subtree with the largest total weight that
+    // holds no landmark is followed down to a leaf, which becomes the next landmark
+    static uint32_t selectAvoid(const DirectedGraph& directed, uint32_t root, const std::vector<std::vector<float>>& from, Search& search)
+    {
+        std::vector<float> rootDist;
+        search.run(directed.forward(), root, rootDist);
+
+        const size_t numNodes = rootDist.size();
+        std::vector<double> size(numNodes, 0.0);
+        std::vector<uint8_t> hasLandmark(numNodes, 0);
+        for (const std::vector<float>& landmark : from)
+        {
+            for (uint32_t n = 0; n < numNodes; n++) { hasLandmark[n] |= landmark[n] == 0; }
+        }
+
+        for (uint32_t n : search.order)
+        {
+            float bound = 0;
+            for (const std::vector<float>& landmark : from)
+            {
+                if (landmark[n] != Unreachable && landmark[root] != Unreachable) { bound = std::max(bound, landmark[n] - landmark[root]); }
+            }
+            size[n] = std::max(0.0, double(rootDist[n]) - double(bound));
+        }
+
+        // children come after their parents in the settled order, so one backwards pass sums the subtrees
+        std::vector<uint32_t> bestChild(numNodes, UINT32_MAX);
+        for (size_t i = search.order.size(); i-- > 1; )
+        {
+            const uint32_t n = search.order[i];
+            const uint32_t p = search.parent[n];
+            if (hasLandmark[n]) { hasLandmark[p] = 1; size[n] = 0; continue; }
+
+            size[p] += size[n];
+            if (size[n] > 0 && (bestChild[p] == UINT32_MAX || size[n] > size[bestChild[p]])) { bestChild[p] = n; }
+        }
+
+        if (bestChild[root] == UINT32_MAX) { return UINT32_MAX; }
+        uint32_t n = root;
+        while (bestChild[n] != UINT32_MAX) { n = bestChild[n]; }
+        return n;
+    }
+};
+
+// the landmark bounds of one query as a heuristic, towards the goal, or backwards from the start
+// for the backward side of a bidirectional search
+class LandmarkHeuristic
+{
+    const Landmarks&        m_landmarks;
+    std::vector<uint32_t>   m_active;
+    uint32_t                m_target;
+    bool                    m_fromTarget;
+
+public:
+
+    LandmarkHeuristic(const Landmarks& landmarks, const std::vector<uint32_t>& active, uint32_t target, bool fromTarget = false)
+        : m_landmarks(landmarks)
+        , m_active(active)
+        , m_target(target)
+        , m_fromTarget(fromTarget)
+    {
+    }
+
+    float operator()(uint32_t node) const
+    {
+        float bound = 0;
+        for (uint32_t l : m_active)
+        {
+            bound = std::max(bound, m_fromTarget ? m_landmarks.lowerBound(m_target, node, l) : m_landmarks.lowerBound(node, m_target, l));
+        }
+        return bound;
+    }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+// geometry of a freshly parsed way, published to the gui so it can be drawn while loading
+struct PreviewWay
+{
+    std::string                 highway;
+    std::vector<sf::Vector2f>   points;
+};
+
+// shared state between a map loading thread and the gui thread
+// the loader publishes ways in batches, the gui takes whatever has arrived each frame
+class LoadProgress
+{
+    std::mutex                  m_mutex;
+    std::vector<PreviewWay>     m_pending;
+
+public:
+
+    std::atomic<size_t>         bytesParsed = 0;
+    std::atomic<size_t>         totalBytes = 0;
+    std::atomic<size_t>         waysParsed = 0;
+    std::atomic<const char*>    stage = "Waiting";
+    std::atomic<bool>           done = false;
+    std::atomic<bool>           cancel = false;
+
+    // called by the loader threads, appends a batch of ways for the gui to draw
+    void publish(std::vector<PreviewWay>& batch, size_t bytes)
+    {
+        waysParsed += batch.size();
+        bytesParsed += bytes;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.insert(m_pending.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+        batch.clear();
+    }
+
+    // called by the gui thread, takes every way published since the last call
+    std::vector<PreviewWay> takePending()
+    {
+        std::vector<PreviewWay> ways;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ways.swap(m_pending);
+        return ways;
+    }
+};
@@ -0,0 +1,531 @@
+#pragma once
+
+#include "MapData.hpp"
+#include "MappedFile.hpp"
+#include "OSMPBFReader.hpp"
+#include "OSMXMLReader.hpp"
+#include "Timer.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// compiled binary snapshot of a loaded map, stored next to the source file as <file>.nlmap
+//
+// the file is a fixed header, a section table, and then a list of flat 8 byte aligned arrays
+// every array can be used in place straight from a memory mapping, nothing is deserialized
+// the snapshot is keyed by a hash of the source file contents, so a changed source file
+// simply misses the cache and a new snapshot is written after it has been parsed
+class MapCache
+{
+public:
+
+    static constexpr char     Magic[8] = { 'N', 'L', 'M', 'A', 'P', 0, 0, 0 };
+    static constexpr uint32_t Version = 4;
+
+    enum Section : uint32_t
+    {
+        NodePositions = 0,  // float x, y per node
+        NodeEdgeOffsets,    // uint32 per node + 1, offsets into NodeEdges
+        NodeEdges,          // uint32 connected node index per edge
+        NodeEdgeWays,       // uint32 way index per edge, see Graph::AgainstWay
+        WayIDs,             // uint64 per way
+        WayCounts,          // int32 per way, the node count stated in the source file
+        WayNodeOffsets,     // uint64 per way + 1, offsets into WayNodes
+        WayNodes,           // uint32 node index per way vertex
+        FirstTagSection     // followed by 3 sections per string field, see tagSection()
+    };
+
+    // each tag field of a way is stored as three sections: the string offsets of the field's
+    // dictionary (uint32), its characters, and the uint32 code of every way
+    enum TagPart : uint32_t { TagStringOffsets = 0, TagChars, TagCodes, NumTagParts };
+
+    static constexpr uint32_t NumTagFields = WayTag::Count;
+    static constexpr uint32_t NumSections  = FirstTagSection + NumTagParts * NumTagFields;
+
+    static constexpr uint32_t tagSection(uint32_t field, TagPart part)
+    {
+        return FirstTagSection + field * NumTagParts + part;
+    }
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t numSections;
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+        uint64_t numNodes;
+        uint64_t numWays;
+    };
+
+    struct SectionEntry
+    {
+        uint64_t offset;
+        uint64_t bytes;
+    };
+
+    // read only view of a mapped cache file, the arrays point directly into the mapping
+    class View
+    {
+        MappedFile          m_file;
+        const Header*       m_header = nullptr;
+        const SectionEntry* m_sections = nullptr;
+
+    public:
+
+        // maps the file and validates it against the expected source, returns false on any mismatch
+        bool open(const std::string& filename, uint64_t sourceHash, uint64_t sourceSize)
+        {
+            if (!m_file.open(filename)) { return false; }
+
+            size_t tableEnd = sizeof(Header) + NumSections * sizeof(SectionEntry);
+            if (m_file.size() < tableEnd) { return false; }
+
+            m_header = reinterpret_cast<const Header*>(m_file.data());
+            m_sections = reinterpret_cast<const SectionEntry*>(m_file.data() + sizeof(Header));
+
+            if (std::memcmp(m_header->magic, Magic, sizeof(Magic)) != 0) { return false; }
+            if (m_header->version != Version)                            { return false; }
+            if (m_header->numSections != NumSections)                    { return false; }
+            if (m_header->sourceHash != sourceHash)                      { return false; }
+            if (m_header->sourceSize != sourceSize)                      { return false; }
+
+            for (uint32_t i = 0; i < NumSections; i++)
+            {
+                const SectionEntry& s = m_sections[i];
+                if (s.offset % 8 != 0 || s.offset < tableEnd)        { return false; }
+                if (s.offset > m_file.size())                       { return false; }
+                if (s.bytes > m_file.size() - s.offset)             { return false; }
+            }
+
+            return true;
+        }
+
+        const Header& header() const
+        {
+            return *m_header;
+        }
+
+        template <class T>
+        const T* array(uint32_t section) const
+        {
+            return reinterpret_cast<const T*>(m_file.data() + m_sections[section].offset);
+        }
+
+        template <class T>
+        size_t count(uint32_t section) const
+        {
+            return size_t(m_sections[section].bytes / sizeof(T));
+        }
+    };
+
+    // fast 64 bit content hash, used only to detect that the source file has changed
+    static uint64_t hashContents(const char* data, size_t size)
+    {
+        const uint64_t prime = 0x9E3779B97F4A7C15ull;
+        uint64_t h = 0xcbf29ce484222325ull ^ (size * prime);
+
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i, 8);
+            h = (h ^ word) * prime;
+            h ^= h >> 29;
+        }
+
+        for (; i < size; i++)
+        {
+            h = (h ^ uint8_t(data[i])) * prime;
+        }
+
+        return h ^ (h >> 32);
+    }
+
+    // parses a source map file with the importer for its format, without using the cache
+    static void parseSource(MapData& map, const std::string& filename)
+    {
+        if      (OSMPBFReader::isPBF(filename)) { OSMPBFReader::load(map, filename); }
+        else if (OSMXMLReader::isXML(filename)) { OSMXMLReader::load(map, filename); }
+        else                                    { map.loadFromFile(filename); }
+    }
+
+    // loads the map from <filename>.nlmap if it was built from the current contents of filename
+    // otherwise parses filename as usual and writes a fresh snapshot for the next launch
+    // the hierarchies and landmarks are left to loadHierarchy() and loadLandmarks()
+    static void loadMap(MapData& map, const std::string& filename)
+    {
+        MappedFile source(filename);
+        if (!source.isOpen())
+        {
+            parseSource(map, filename);
+            return;
+        }
+
+        LoadProgress* progress = map.getProgress();
+        if (progress)
+        {
+            progress->stage = "Checking map cache";
+            progress->totalBytes = source.size();
+        }
+
+        uint64_t sourceHash = hashContents(source.data(), source.size());
+        uint64_t sourceSize = source.size();
+        source.close();
+
+        std::string cacheFile = filename + ".nlmap";
+
+        Timer timer;
+        if (load(cacheFile, sourceHash, sourceSize, map))
+        {
+            if (progress)
+            {
+                progress->bytesParsed = size_t(sourceSize);
+                progress->waysParsed = map.getWays().size();
+            }
+
+            std::cout << "Loaded map cache " << cacheFile << ": " << map.getWays().size() << " ways, "
+                      << map.getNodes().size() << " nodes in " << timer.getElapsedSec() << "s\n";
+            return;
+        }
+
+        parseSource(map, filename);
+        if (map.getWays().empty() || map.isCancelled()) { return; }
+
+        if (progress) { progress->stage = "Writing map cache"; }
+        timer.start();
+        if (save(cacheFile, sourceHash, sourceSize, map.getWays(), map.getNodes(), map.getGraph(), map.getWayData().getTags()))
+        {
+            std::cout << "Wrote map cache " << cacheFile << " in " << timer.getElapsedSec() << "s\n";
+        }
+    }
+
+    // the contraction hierarchy of a travel mode is kept next to the map as <file>.<mode>.ch
+    // a hierarchy built from a different graph or speed table misses and is rebuilt. building one
+    // takes minutes on large maps, so it is not part of loadMap(), the gui calls this per mode on
+    // a worker thread once the map is shown
+    static void loadHierarchy(MapData& map, const std::string& filename, TravelMode mode)
+    {
+        LoadProgress* progress = map.getProgress();
+        if (progress) { progress->stage = "Building contraction hierarchy"; }
+
+        const std::string hierarchyFile = filename + "." + getTravelModeName(mode) + ".ch";
+        const uint64_t graphHash = hashDirectedGraph(map.getDirectedGraph(mode));
+
+        Timer timer;
+        ContractionHierarchy& hierarchy = map.getHierarchy(mode);
+        if (hierarchy.load(hierarchyFile, graphHash, map.getGraph().numNodes(), map.getGraph().numEdges()))
+        {
+            std::cout << "Loaded contraction hierarchy " << hierarchyFile << " in " << timer.getElapsedSec() << "s\n";
+            return;
+        }
+
+        map.buildHierarchy(mode);
+        if (map.isCancelled()) { return; }
+        if (!hierarchy.save(hierarchyFile, graphHash)) { std::cout << "Could not write " << hierarchyFile << "\n"; }
+    }
+
+    // the landmark tables of a travel mode are kept next to the map as <file>.<mode>.alt, keyed by
+    // the same graph hash as the hierarchies. like loadHierarchy(), the gui calls this per mode on a
+    // worker thread once the map is shown
+    static void loadLandmarks(MapData& map, const std::string& filename, TravelMode mode)
+    {
+        LoadProgress* progress = map.getProgress();
+        if (progress) { progress->stage = "Computing landmarks"; }
+
+        const std::string landmarkFile = filename + "." + getTravelModeName(mode) + ".alt";
+        const uint64_t graphHash = hashDirectedGraph(map.getDirectedGraph(mode));
+
+        Timer timer;
+        Landmarks& landmarks = map.getLandmarks(mode);
+        if (landmarks.load(landmarkFile, graphHash, map.getGraph().numNodes()))
+        {
+            std::cout << "Loaded landmarks " << landmarkFile << " in " << timer.getElapsedSec() << "s\n";
+            return;
+        }
+
+        map.buildLandmarks(mode);
+        if (map.isCancelled()) { return; }
+        if (!landmarks.save(landmarkFile, graphHash)) { std::cout << "Could not write " << landmarkFile << "\n"; }
+    }
+
+    // the hub labels of every travel mode are kept next to the map as <file>.<mode>.hl and mapped
+    // into memory rather than read. they are not part of loading a map, since they take several
+    // times the memory of the hierarchies they are built from. callers that want them, like
+    // Benchmark::reportHubLabels(), call this after loading
+    static void loadHubLabels(MapData& map, const std::string& filename)
+    {
+        for (size_t m = 0; m < NumTravelModes && !map.isCancelled(); m++)
+        {
+            const TravelMode mode = TravelMode(m);
+            const std::string labelFile = filename + "." + getTravelModeName(mode) + ".hl";
+            const uint64_t graphHash = hashDirectedGraph(map.getDirectedGraph(mode));
+
+            Timer timer;
+            HubLabels& labels = map.getHubLabels(mode);
+            if (labels.load(labelFile, graphHash, map.getGraph().numNodes()))
+            {
+                std::cout << "Mapped hub labels " << labelFile << " in " << timer.getElapsedSec() << "s\n";
+                continue;
+            }
+
+            if (map.getHierarchy(mode).empty()) { map.buildHierarchy(mode); }
+            map.buildHubLabels(mode);
+            if (map.isCancelled()) { return; }
+
+            // mapped back from the file, so the built labels don't stay in memory next to the page cache
+            if (!labels.save(labelFile, graphHash) || !labels.load(labelFile, graphHash, map.getGraph().numNodes()))
+            {
+                std::cout << "Could not write " << labelFile << "\n";
+            }
+        }
+    }
+
+    // identifies the exact edges and weights a hierarchy, landmark table or hub labeling was computed from
+    // the graph edge ids are part of it, hierarchies unpack their shortcuts into them, and a way added to
+    // the source can shift them without changing the edges of a mode that may not use it
+    static uint64_t hashDirectedGraph(const DirectedGraph& directed)
+    {
+        const DirectedGraph::Adjacency& forward = directed.forward();
+        auto hashArray = [](const auto& values)
+        {
+            return hashContents(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(values[0]));
+        };
+        uint64_t h = hashArray(forward.getOffsets());
+        h = h * 31 + hashArray(forward.getTargets());
+        h = h * 31 + hashArray(forward.getWeights());
+        h = h * 31 + hashArray(forward.getGraphEdges());
+        return h;
+    }
+
+    static bool load(const std::string& filename, uint64_t sourceHash, uint64_t sourceSize, MapData& map)
+    {
+        View view;
+        if (!view.open(filename, sourceHash, sourceSize)) { return false; }
+
+        const size_t numNodes = size_t(view.header().numNodes);
+        const size_t numWays  = size_t(view.header().numWays);
+
+        // every array has to be exactly as long as the header says before we index into it
+        if (view.count<float>(NodePositions)      != 2 * numNodes)  { return false; }
+        if (view.count<uint32_t>(NodeEdgeOffsets) != numNodes + 1)  { return false; }
+        if (view.count<uint64_t>(WayIDs)          != numWays)       { return false; }
+        if (view.count<int32_t>(WayCounts)        != numWays)       { return false; }
+        if (view.count<uint64_t>(WayNodeOffsets)  != numWays + 1)   { return false; }
+
+        const float*    positions   = view.array<float>(NodePositions);
+        const uint32_t* edgeOffsets = view.array<uint32_t>(NodeEdgeOffsets);
+        const uint32_t* edges       = view.array<uint32_t>(NodeEdges);
+        const size_t    numEdges    = view.count<uint32_t>(NodeEdges);
+        const uint32_t* edgeWays    = view.array<uint32_t>(NodeEdgeWays);
+        if (view.count<uint32_t>(NodeEdgeWays) != numEdges) { return false; }
+
+        // positions are stored once per node, the packed node ids are derived from them
+        std::vector<Node> nodes(numNodes);
+        std::vector<sf::Vector2f> nodePositions(numNodes);
+        for (size_t i = 0; i < numNodes; i++)
+        {
+            nodes[i] = Node(positions[2 * i], positions[2 * i + 1]);
+            nodes[i].index = uint32_t(i);
+            nodePositions[i] = nodes[i].p;
+        }
+
+        // the edge sections are the graph's own csr arrays, they only need to be checked and copied
+        if (edgeOffsets[0] != 0 || edgeOffsets[numNodes] != numEdges) { return false; }
+        for (size_t i = 0; i < numNodes; i++)
+        {
+            if (edgeOffsets[i] > edgeOffsets[i + 1]) { return false; }
+        }
+        for (size_t e = 0; e < numEdges; e++)
+        {
+            if (edges[e] >= numNodes || (edgeWays[e] & ~Graph::AgainstWay) >= numWays) { return false; }
+        }
+
+        Graph graph;
+        graph.assign(std::vector<uint32_t>(edgeOffsets, edgeOffsets + numNodes + 1), std::vector<uint32_t>(edges, edges + numEdges),
+                     std::vector<uint32_t>(edgeWays, edgeWays + numEdges), std::move(nodePositions));
+
+        const uint64_t* wayIDs         = view.array<uint64_t>(WayIDs);
+        const int32_t*  wayCounts      = view.array<int32_t>(WayCounts);
+        const uint64_t* wayNodeOffsets = view.array<uint64_t>(WayNodeOffsets);
+        const uint32_t* wayNodes       = view.array<uint32_t>(WayNodes);
+        const size_t    numWayNodes    = view.count<uint32_t>(WayNodes);
+
+        std::vector<Way> ways(numWays);
+        for (size_t w = 0; w < numWays; w++)
+        {
+            if (wayNodeOffsets[w] > wayNodeOffsets[w + 1] || wayNodeOffsets[w + 1] > numWayNodes) { return false; }
+
+            Way& way = ways[w];
+            way.index = w;
+            way.id = wayIDs[w];
+            way.count = wayCounts[w];
+
+            // a way keeps its own copy of each vertex, along with the index of the shared node
+            size_t first = size_t(wayNodeOffsets[w]);
+            size_t size  = size_t(wayNodeOffsets[w + 1] - wayNodeOffsets[w]);
+            way.nodes.reserve(size);
+            for (size_t i = 0; i < size; i++)
+            {
+                if (wayNodes[first + i] >= numNodes) { return false; }
+                way.nodes.push_back(Node(nodes[wayNodes[first + i]].p.x, nodes[wayNodes[first + i]].p.y));
+                way.nodes.back().index = wayNodes[first + i];
+            }
+        }
+
+        WayTagDictionary tags;
+        for (uint32_t f = 0; f < NumTagFields; f++)
+        {
+            const uint32_t* stringOffsets = view.array<uint32_t>(tagSection(f, TagStringOffsets));
+            const char*     chars         = view.array<char>(tagSection(f, TagChars));
+            const uint32_t* codes         = view.array<uint32_t>(tagSection(f, TagCodes));
+            const size_t    numStrings    = view.count<uint32_t>(tagSection(f, TagStringOffsets));
+            const size_t    numChars      = view.count<char>(tagSection(f, TagChars));
+
+            if (numStrings == 0 || view.count<uint32_t>(tagSection(f, TagCodes)) != numWays) { return false; }
+
+            // the stored dictionary is rebuilt in order, so every string gets back its stored code
+            for (uint32_t i = 0; i + 1 < numStrings; i++)
+            {
+                if (stringOffsets[i] > stringOffsets[i + 1] || stringOffsets[i + 1] > numChars) { return false; }
+                std::string_view value(chars + stringOffsets[i], stringOffsets[i + 1] - stringOffsets[i]);
+                if (tags.encode(WayTag::Field(f), value) != i) { return false; }
+            }
+
+            for (size_t w = 0; w < numWays; w++)
+            {
+                if (codes[w] >= numStrings - 1) { return false; }
+                ways[w].tags[f] = codes[w];
+            }
+        }
+
+        map.getWayData().setWays(std::move(ways));
+        map.getWayData().getTags() = std::move(tags);
+        map.setNodeData(std::move(nodes), std::move(graph));
+        return true;
+    }
+
+    static bool save(const std::string& filename, uint64_t sourceHash, uint64_t sourceSize,
+                     const std::vector<Way>& ways, const std::vector<Node>& nodes, const Graph& graph, const WayTagDictionary& tags)
+    {
+        // node indexes are stored as 32 bit values
+        if (nodes.size() >= UINT32_MAX) { return false; }
+
+        // each section is a span of one of the arrays below, which all stay alive until written
+        std::vector<std::pair<const char*, size_t>> sections(NumSections);
+
+        if (graph.numNodes() != nodes.size()) { return false; }
+
+        std::vector<float> positions;
+        positions.reserve(2 * nodes.size());
+        for (const Node& node : nodes)
+        {
+            positions.push_back(node.p.x);
+            positions.push_back(node.p.y);
+        }
+
+        std::vector<uint64_t> wayIDs;
+        std::vector<int32_t>  wayCounts;
+        std::vector<uint64_t> wayNodeOffsets{ 0 };
+        std::vector<uint32_t> wayNodes;
+        for (const Way& way : ways)
+        {
+            wayIDs.push_back(way.id);
+            wayCounts.push_back(way.count);
+            // way vertices carry the index of their shared node, see MapData::buildNodeData
+            for (const Node& n : way.nodes)
+            {
+                if (n.index >= nodes.size() || nodes[n.index].id() != n.id()) { return false; }
+                wayNodes.push_back(uint32_t(n.index));
+            }
+            wayNodeOffsets.push_back(wayNodes.size());
+        }
+
+        setSection(sections[NodePositions], positions);
+        setSection(sections[NodeEdgeOffsets], graph.getOffsets());
+        setSection(sections[NodeEdges], graph.getTargets());
+        setSection(sections[NodeEdgeWays], graph.getEdgeWays());
+        setSection(sections[WayIDs], wayIDs);
+        setSection(sections[WayCounts], wayCounts);
+        setSection(sections[WayNodeOffsets], wayNodeOffsets);
+        setSection(sections[WayNodes], wayNodes);
+
+        std::vector<std::vector<uint32_t>> tagStringOffsets(NumTagFields);
+        std::vector<std::vector<char>>     tagChars(NumTagFields);
+        std::vector<std::vector<uint32_t>> tagCodes(NumTagFields);
+        for (uint32_t f = 0; f < NumTagFields; f++)
+        {
+            const StringDictionary& dictionary = tags.getField(WayTag::Field(f));
+            std::vector<uint32_t>& stringOffsets = tagStringOffsets[f];
+            std::vector<char>&     chars = tagChars[f];
+            std::vector<uint32_t>& codes = tagCodes[f];
+
+            stringOffsets.push_back(0);
+            for (uint32_t code = 0; code < dictionary.size(); code++)
+            {
+                const std::string& value = dictionary.decode(code);
+                chars.insert(chars.end(), value.begin(), value.end());
+                stringOffsets.push_back(uint32_t(chars.size()));
+            }
+
+            codes.reserve(ways.size());
+            for (const Way& way : ways) { codes.push_back(way.tags[f]); }
+
+            setSection(sections[tagSection(f, TagStringOffsets)], stringOffsets);
+            setSection(sections[tagSection(f, TagChars)], chars);
+            setSection(sections[tagSection(f, TagCodes)], codes);
+        }
+
+        Header header;
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version     = Version;
+        header.numSections = NumSections;
+        header.sourceHash  = sourceHash;
+        header.sourceSize  = sourceSize;
+        header.numNodes    = nodes.size();
+        header.numWays     = ways.size();
+
+        std::vector<SectionEntry> table(NumSections);
+        uint64_t offset = align8(sizeof(Header) + NumSections * sizeof(SectionEntry));
+        for (uint32_t i = 0; i < NumSections; i++)
+        {
+            table[i] = { offset, sections[i].second };
+            offset = align8(offset + sections[i].second);
+        }
+
+        return writeFileAtomically(filename, [&](std::ofstream& out)
+        {
+            const char padding[8] = {};
+            out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            out.write(reinterpret_cast<const char*>(table.data()), std::streamsize(table.size() * sizeof(SectionEntry)));
+            uint64_t written = sizeof(Header) + table.size() * sizeof(SectionEntry);
+            for (uint32_t i = 0; i < NumSections; i++)
+            {
+                out.write(padding, std::streamsize(table[i].offset - written));
+                out.write(sections[i].first, std::streamsize(sections[i].second));
+                written = table[i].offset + sections[i].second;
+            }
+        });
+    }
+
+private:
+
+    static uint64_t align8(uint64_t offset)
+    {
+        return (offset + 7) & ~uint64_t(7);
+    }
+
+    template <class T>
+    static void setSection(std::pair<const char*, size_t>& section, const std::vector<T>& values)
+    {
+        section = { reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T) };
+    }
+};
@@ -1,96 +1,233 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <vector>
 #include <fstream>
 #include <iostream>
 #include <bit>
+#include <charconv>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "MappedFile.hpp"
+#include "DecompressingReader.hpp"
+#include "StringDictionary.hpp"
+#include "LoadProgress.hpp"
+#include "Timer.hpp"
+#include "MemoryUsage.hpp"
+#include "FlatIndexMap.hpp"
+#include "ParallelFor.hpp"
+#include "RadixSort.hpp"
+#include "Graph.hpp"
+#include "HilbertCurve.hpp"
+#include "SpeedTable.hpp"
+#include "TravelMode.hpp"
+#include "DirectedGraph.hpp"
+#include "ContractionHierarchy.hpp"
+#include "Landmarks.hpp"
+#include "HubLabels.hpp"
+#include "CustomizableRoutePlanner.hpp"
 
 #include <SFML/Graphics.hpp>
 
 
+// a map vertex, either a shared node in NodeData or a way's own copy of it
+// the connections between nodes are stored in the Graph, not in the nodes
+// 12 bytes: the id is derived from the position instead of being stored, and a 32 bit index
+// is enough for any map short of the whole planet
 struct Node
 {
     sf::Vector2f p;
-    uint64_t id = 0;
-    uint64_t index = 0;
-    std::vector<uint64_t> wayIDs;
-    std::vector<uint64_t> connectedNodeIDs;
-    std::vector<uint64_t> connectedNodeIndexes;
+    uint32_t index = 0;
 
     Node() = default;
 
     Node(float x, float y)
         : p(x, y)
     {
-        id = pack_floats(x, y);
     }
 
-    inline uint64_t pack_floats(float x, float y) 
+    // nodes are identified by their exact position, packed into 64 bits
+    uint64_t id() const
+    {
+        return pack_floats(p.x, p.y);
+    }
+
+    static uint64_t pack_floats(float x, float y)
     {
         return (uint64_t(std::bit_cast<uint32_t>(x)) << 32) | uint64_t(std::bit_cast<uint32_t>(y));
     }
 };
 
+// walks the comma separated fields of a single csv line without copying them
+// behaves exactly like repeated std::getline(ss, field, ',') on a stringstream of the line
+class CSVLineReader
+{
+    std::string_view m_rest;
+
+public:
+
+    explicit CSVLineReader(std::string_view line)
+        : m_rest(line)
+    {
+    }
+
+    bool next(std::string_view& field)
+    {
+        if (m_rest.empty()) { return false; }
+
+        size_t comma = m_rest.find(',');
+        if (comma == std::string_view::npos)
+        {
+            field = m_rest;
+            m_rest = std::string_view();
+        }
+        else
+        {
+            field = m_rest.substr(0, comma);
+            m_rest.remove_prefix(comma + 1);
+        }
+
+        return true;
+    }
+};
+
+// std::from_chars does not skip leading whitespace or a leading '+' like std::stoi / std::stof
+// do, so strip those first to accept exactly the same tokens as the stringstream parser did
+template <class T>
+inline bool parseNumber(std::string_view token, T& value)
+{
+    size_t start = 0;
+    while (start < token.size() && std::isspace(static_cast<unsigned char>(token[start]))) { start++; }
+    if (start < token.size() && token[start] == '+') { start++; }
+
+    const char* begin = token.data() + start;
+    const char* end   = token.data() + token.size();
+    auto [ptr, ec] = std::from_chars(begin, end, value);
+    return ec == std::errc() && ptr != begin;
+}
+
+// the tag columns of the ways csv, in file order after the way id
+struct WayTag
+{
+    enum Field : uint8_t
+    {
+        Highway, Name, Type, Service, MaxSpeed, OneWay, Bicycle, Foot, Access, Sidewalk,
+        Surface, Lanes, Lit, Bridge, Tunnel, MotorVehicle, MotorCar, Bus, Area, Junction,
+        Count
+    };
+
+    static const char* getName(Field field)
+    {
+        static const char* names[Count] =
+        {
+            "highway", "name", "type", "service", "maxspeed", "oneway", "bicycle", "foot", "access", "sidewalk",
+            "surface", "lanes", "lit", "bridge", "tunnel", "motor_vehicle", "motorcar", "bus", "area", "junction"
+        };
+        return names[field];
+    }
+};
+
+// one string dictionary per tag field, ways only store the integer codes
+class WayTagDictionary
+{
+    StringDictionary m_fields[WayTag::Count];
+
+public:
+
+    uint32_t encode(WayTag::Field field, std::string_view value)
+    {
+        return m_fields[field].encode(value);
+    }
+
+    const std::string& decode(WayTag::Field field, uint32_t code) const
+    {
+        return m_fields[field].decode(code);
+    }
+
+    const StringDictionary& getField(WayTag::Field field) const
+    {
+        return m_fields[field];
+    }
+
+    // adds every string of other to this dictionary and returns, per field, the
+    // code in this dictionary of each code in other
+    std::vector<std::vector<uint32_t>> merge(const WayTagDictionary& other)
+    {
+        std::vector<std::vector<uint32_t>> remap(WayTag::Count);
+        for (size_t f = 0; f < WayTag::Count; f++)
+        {
+            const StringDictionary& field = other.m_fields[f];
+            remap[f].resize(field.size());
+            for (uint32_t code = 0; code < field.size(); code++)
+            {
+                remap[f][code] = m_fields[f].encode(field.decode(code));
+            }
+        }
+        return remap;
+    }
+
+    size_t getMemoryBytes() const
+    {
+        size_t bytes = 0;
+        for (const StringDictionary& field : m_fields) { bytes += field.getMemoryBytes(); }
+        return bytes;
+    }
+};
+
 struct Way 
 {
     uint64_t index = 0;
     uint64_t id = 0;
-    std::string way_id;
-    std::string highway;
-    std::string name;
-    std::string type;
-    std::string service;
-    std::string maxspeed;
-    std::string oneway;
-    std::string bicycle;
-    std::string foot;
-    std::string access;
-    std::string sidewalk;
-    std::string surface;
-    std::string lanes;
-    std::string lit;
-    std::string bridge;
-    std::string tunnel;
-    std::string motor_vehicle;
-    std::string motorcar;
-    std::string bus;
-    std::string area;
-    std::string junction;
-    std::string nodes_count;
-    int         count = 0;
+    int      count = 0;
+    uint32_t tags[WayTag::Count] = {};
     std::vector<Node> nodes;
 
-    bool parseFromCSVLine(const std::string& line) 
+    // the dictionary code of a tag, resolve it to text with the way data's tag dictionary
+    uint32_t getTag(WayTag::Field field) const
     {
-        std::stringstream ss(line);
-        std::string token;
+        return tags[field];
+    }
 
-        #define READ(f) { if (!std::getline(ss, f, ',')) { return false; } }
+    // parses a single line of the ways csv in place, without any temporary strings
+    // tag values are stored as codes into the given dictionary
+    bool parseFromCSV(std::string_view line, WayTagDictionary& dictionary)
+    {
+        CSVLineReader reader(line);
+        std::string_view wayID, field;
 
-        READ(way_id);   READ(highway);       READ(name);     READ(type); READ(service);
-        READ(maxspeed); READ(oneway);        READ(bicycle);  READ(foot); READ(access);
-        READ(sidewalk); READ(surface);       READ(lanes);    READ(lit);  READ(bridge);
-        READ(tunnel);   READ(motor_vehicle); READ(motorcar); READ(bus);  READ(area);
-        READ(junction); READ(nodes_count);
+        if (!reader.next(wayID)) { return false; }
+        for (size_t f = 0; f < WayTag::Count; f++)
+        {
+            if (!reader.next(field)) { return false; }
+            tags[f] = dictionary.encode(WayTag::Field(f), field);
+        }
+
+        if (!reader.next(field) || !parseNumber(field, count)) { return false; }
 
-        try { count = std::stoi(nodes_count); }
-        catch (...) { return false; }
+        nodes.reserve(count > 0 ? size_t(count) : 0);
 
         float x = 0, y = 0;
         for (int i = 0; i < 2 * count; ++i)
         {
-            if (!std::getline(ss, token, ',')) break;
-            x = std::stof(token);
-            if (!std::getline(ss, token, ',')) break;
-            y = std::stof(token);
+            if (!reader.next(field)) break;
+            if (!parseNumber(field, x)) { return false; }
+            if (!reader.next(field)) break;
+            if (!parseNumber(field, y)) { return false; }
 
             // the data needed to be rotated to match the sfml drawing direction
             nodes.push_back(Node(y, -x));
         }
 
-        id = std::stoull(way_id);
+        if (!parseNumber(wayID, id)) { return false; }
 
         return true;
     }
@@ -98,52 +235,173 @@ struct Way
 
 class NodeData
 {
-    std::unordered_map<uint64_t, Node> m_nodeMap;
+    FlatIndexMap m_indexByID;       // packed node id -> index into m_nodes
     std::vector<Node> m_nodes;
+    Graph m_graph;
 
 public:
 
     NodeData() = default;
 
-    void createVectorizedData()
+    // presizes the id table for the given number of node occurrences so it never has to grow
+    // the node array itself is not reserved, since many occurrences are shared nodes
+    void reserve(size_t numNodes)
     {
-        std::cout << "Processing Node Data...";
+        m_indexByID.reserve(numNodes);
+    }
 
-        // create the vector with all the node data
-        for (auto& [nodeID, node] : m_nodeMap)
+    // adds the node if its id is new, returns the index of the node either way
+    uint32_t addNode(const Node& node)
+    {
+        auto [index, inserted] = m_indexByID.insert(node.id());
+
+        if (inserted)
         {
-            node.index = m_nodes.size();
             m_nodes.push_back(node);
+            m_nodes.back().index = index;
         }
 
-        // loop over it one final time to get the node indexes
-        for (auto& node : m_nodes)
+        return index;
+    }
+
+    // builds the graph once every way vertex has been added and holds its node index
+    void buildGraph(const std::vector<Way>& ways)
+    {
+        std::vector<sf::Vector2f> positions(m_nodes.size());
+        for (size_t n = 0; n < m_nodes.size(); n++) { positions[n] = m_nodes[n].p; }
+        m_graph.build(ways, std::move(positions));
+    }
+
+    // the sort based alternative to addNode for very large maps, builds the nodes and the graph at once
+    // every way vertex becomes an (id, way, position) tuple, the tuples are radix sorted by id in
+    // parallel, and each run of equal ids becomes one node. nodes are numbered in id order, so the
+    // numbering is deterministic, and edges keep the same order as with addNode and buildGraph
+    // the id lookup of getNodeByID is not built
+    void buildSorted(std::vector<Way>& ways, size_t numThreads)
+    {
+        struct VertexRef
         {
-            for (size_t i = 0; i < node.connectedNodeIDs.size(); i++)
+            uint64_t id;
+            uint32_t way;
+            uint32_t position;
+        };
+
+        std::vector<size_t> wayOffsets(ways.size() + 1, 0);
+        for (size_t w = 0; w < ways.size(); w++) { wayOffsets[w + 1] = wayOffsets[w] + ways[w].nodes.size(); }
+
+        std::vector<VertexRef> refs(wayOffsets.back());
+        parallelFor(numThreads, ways.size(), [&](size_t, size_t begin, size_t end)
+        {
+            for (size_t w = begin; w < end; w++)
             {
-                node.connectedNodeIndexes.push_back(getNodeByID(node.connectedNodeIDs[i]).index);
+                for (size_t i = 0; i < ways[w].nodes.size(); i++) { refs[wayOffsets[w] + i] = { ways[w].nodes[i].id(), uint32_t(w), uint32_t(i) }; }
             }
+        }, 1024);
+
+        radixSort(refs, [](const VertexRef& r) { return r.id; }, numThreads);
+
+        // each thread's range starts at the beginning of a run of equal ids
+        numThreads = std::max<size_t>(1, std::min(numThreads, refs.size() / (1 << 14)));
+        std::vector<size_t> bounds(numThreads + 1, refs.size());
+        bounds[0] = 0;
+        for (size_t t = 1; t < numThreads; t++)
+        {
+            size_t b = std::max(bounds[t - 1], refs.size() * t / numThreads);
+            while (b > 0 && b < refs.size() && refs[b].id == refs[b - 1].id) { b++; }
+            bounds[t] = b;
         }
+
+        // count the nodes of every range so each thread knows the index of its first node
+        std::vector<size_t> firstIndex(numThreads + 1, 0);
+        parallelFor(numThreads, numThreads, [&](size_t t, size_t, size_t)
+        {
+            size_t count = 0;
+            for (size_t i = bounds[t]; i < bounds[t + 1]; i++) { count += (i == 0 || refs[i].id != refs[i - 1].id); }
+            firstIndex[t + 1] = count;
+        }, 1);
+        for (size_t t = 0; t < numThreads; t++) { firstIndex[t + 1] += firstIndex[t]; }
+
+        // assign the indexes, and remember where each node's run of vertices starts
+        std::vector<size_t> runStart(firstIndex.back() + 1, refs.size());
+        parallelFor(numThreads, numThreads, [&](size_t t, size_t, size_t)
+        {
+            size_t index = firstIndex[t];
+            for (size_t i = bounds[t]; i < bounds[t + 1]; i++)
+            {
+                if (i > bounds[t] && refs[i].id != refs[i - 1].id) { index++; }
+                if (i == bounds[t] || refs[i].id != refs[i - 1].id) { runStart[index] = i; }
+                ways[refs[i].way].nodes[refs[i].position].index = uint32_t(index);
+            }
+        }, 1);
+
+        // the degree of a node is the number of way neighbors of all the vertices in its run
+        const size_t numNodes = firstIndex.back();
+        auto hasPrev = [&](const VertexRef& r) { return r.position > 0; };
+        auto hasNext = [&](const VertexRef& r) { return r.position + 1 < ways[r.way].nodes.size(); };
+
+        m_indexByID.clear();
+        m_nodes.assign(numNodes, Node());
+        std::vector<sf::Vector2f> positions(numNodes);
+        std::vector<uint32_t> offsets(numNodes + 1, 0);
+        parallelFor(numThreads, numNodes, [&](size_t, size_t begin, size_t end)
+        {
+            for (size_t n = begin; n < end; n++)
+            {
+                const Node& vertex = ways[refs[runStart[n]].way].nodes[refs[runStart[n]].position];
+                m_nodes[n].p = vertex.p;
+                m_nodes[n].index = uint32_t(n);
+                positions[n] = vertex.p;
+
+                for (size_t i = runStart[n]; i < runStart[n + 1]; i++) { offsets[n + 1] += hasPrev(refs[i]) + hasNext(refs[i]); }
+            }
+        }, 1024);
+        // each way adds an edge in both directions between its consecutive vertices, empty ways add none
+        uint64_t numEdges = 0;
+        for (const Way& way : ways) { numEdges += 2 * (std::max<size_t>(way.nodes.size(), 1) - 1); }
+        Graph::checkEdgeCount(numEdges);
+        for (size_t n = 0; n < numNodes; n++) { offsets[n + 1] += offsets[n]; }
+
+        // every vertex of the run adds its neighbors along its way, in the same order buildGraph would
+        std::vector<uint32_t> targets(offsets.back());
+        std::vector<uint32_t> edgeWays(offsets.back());
+        parallelFor(numThreads, numNodes, [&](size_t, size_t begin, size_t end)
+        {
+            for (size_t n = begin; n < end; n++)
+            {
+                uint32_t e = offsets[n];
+                for (size_t i = runStart[n]; i < runStart[n + 1]; i++)
+                {
+                    const std::vector<Node>& wayNodes = ways[refs[i].way].nodes;
+                    if (hasPrev(refs[i])) { edgeWays[e] = refs[i].way | Graph::AgainstWay; targets[e++] = uint32_t(wayNodes[refs[i].position - 1].index); }
+                    if (hasNext(refs[i])) { edgeWays[e] = refs[i].way;                     targets[e++] = uint32_t(wayNodes[refs[i].position + 1].index); }
+                }
+            }
+        }, 1024);
+
+        m_graph.assign(std::move(offsets), std::move(targets), std::move(edgeWays), std::move(positions));
     }
 
-    void addNode(const Node& node)
+    // moves node order[i] to index i in the nodes and the graph, returns the new index of every old node
+    std::vector<uint32_t> renumber(const std::vector<uint32_t>& order)
     {
-        // check to see if the node's id is already in the map
-        auto it = m_nodeMap.find(node.id);
+        std::vector<uint32_t> rank = m_graph.renumber(order);
 
-        // if it's not in the map, add it to the map fresh
-        if (it == m_nodeMap.end())
+        std::vector<Node> nodes(m_nodes.size());
+        for (size_t n = 0; n < nodes.size(); n++)
         {
-            m_nodeMap.insert({ node.id, node });
+            nodes[n] = m_nodes[order[n]];
+            nodes[n].index = uint32_t(n);
         }
-        // if it is in the map, add its connected node ids instead
-        else
+        m_nodes = std::move(nodes);
+
+        // the id table numbers keys in insertion order, so it is rebuilt in the new order
+        if (m_indexByID.size() > 0)
         {
-            for (auto id : node.connectedNodeIDs)
-            {
-                it->second.connectedNodeIDs.push_back(id);
-            }
+            m_indexByID.clear();
+            m_indexByID.reserve(m_nodes.size());
+            for (const Node& node : m_nodes) { m_indexByID.insert(node.id()); }
         }
+        return rank;
     }
 
     std::vector<Node>& getNodes()
@@ -151,25 +409,73 @@ public:
         return m_nodes;
     }
 
+    const Graph& getGraph() const
+    {
+        return m_graph;
+    }
+
+    Graph& getGraph()
+    {
+        return m_graph;
+    }
+
+    // replaces the vectorized node data and the graph directly, used when loading from a map cache
+    void setNodes(std::vector<Node>&& nodes, Graph&& graph)
+    {
+        m_indexByID.clear();
+        m_nodes = std::move(nodes);
+        m_graph = std::move(graph);
+    }
+
+    // only valid for node data built with addNode, a cached or sort built map has no id lookup
     Node& getNodeByID(uint64_t id)
     {
-        return m_nodeMap.at(id);
+        uint32_t index = m_indexByID.find(id);
+        if (index == FlatIndexMap::Missing) { throw std::out_of_range("unknown node id"); }
+        return m_nodes[index];
     }
 };
 
 class WayData
 {
-    std::unordered_map<uint64_t, Way> m_wayMap;
+    std::unordered_set<uint64_t> m_wayIDs;
 
     std::vector<Way> m_ways;
+    WayTagDictionary m_tags;
 
 public:
 
     WayData() = default;
 
-    void addWay(Way& way)
+    WayTagDictionary& getTags()
     {
-        m_wayMap.insert({ way.id, way });
+        return m_tags;
+    }
+
+    const WayTagDictionary& getTags() const
+    {
+        return m_tags;
+    }
+
+    // resolves the text of a way's tag on demand
+    const std::string& getTag(const Way& way, WayTag::Field field) const
+    {
+        return m_tags.decode(field, way.tags[field]);
+    }
+
+    void addWay(const Way& way)
+    {
+        addWay(Way(way));
+    }
+
+    // takes ownership of the parsed way, it is stored once and never copied again
+    // if several ways share an id, the first one added is kept
+    void addWay(Way&& way)
+    {
+        if (!m_wayIDs.insert(way.id).second) { return; }
+
+        way.index = m_ways.size();
+        m_ways.push_back(std::move(way));
     }
 
     std::vector<Way>& getWays()
@@ -177,61 +483,652 @@ public:
         return m_ways;
     }
 
+    // replaces the vectorized way data directly, used when loading from a map cache
+    void setWays(std::vector<Way>&& ways)
+    {
+        m_wayIDs.clear();
+        m_ways = std::move(ways);
+    }
+
+    // ways are already stored in the order they were added, so this only
+    // releases the id set that was needed to drop duplicate ways while loading
     void createVectorizedData()
     {
-        for (auto& [wayID, way] : m_wayMap)
-        {
-            way.index = m_ways.size();
-            m_ways.push_back(way);
-        }
+        m_wayIDs = std::unordered_set<uint64_t>();
     }
 };
 
 class MapData 
 {
+public:
+
+    // how the way vertices are deduplicated into nodes, see buildNodeData
+    // Auto uses the hash table, and the parallel sort for very large maps on several cores
+    enum class NodeDedup { Auto, Hash, Sort };
+
+    static constexpr size_t SortDedupMinVertices = 1 << 24;
+
+private:
+
     WayData     m_wayData;
     NodeData    m_nodeData;
+    std::array<DirectedGraph, NumTravelModes> m_directedGraphs;
+    std::array<std::vector<uint8_t>, NumTravelModes> m_wayDirections;
+    std::array<ContractionHierarchy, NumTravelModes> m_hierarchies;     // empty until built or loaded, see MapCache
+    std::array<Landmarks, NumTravelModes> m_landmarks;                  // likewise
+    std::array<HubLabels, NumTravelModes> m_hubLabels;                  // empty until built from a hierarchy or loaded
+    std::array<CustomizableRoutePlanner, NumTravelModes> m_routePlanners;
+    size_t      m_numThreads = std::max(1u, std::thread::hardware_concurrency());
+    NodeDedup   m_nodeDedup = NodeDedup::Auto;
+    bool        m_fixedPointPositions = false;
+    bool        m_spatialOrder = true;
+    SpeedTable  m_speedTable;
+    LoadProgress* m_progress = nullptr;
 
 public:
 
-    void loadFromFile(const std::string& filename) 
+    // optional progress reporting, used when the map is loaded on a background thread
+    void setProgress(LoadProgress* progress)
     {
-        std::ifstream file(filename);
+        m_progress = progress;
+    }
 
-        std::string line;
+    LoadProgress* getProgress() const
+    {
+        return m_progress;
+    }
 
-        // skip header
-        if (!std::getline(file, line)) { return; }
+    bool isCancelled() const
+    {
+        return m_progress && m_progress->cancel;
+    }
 
-        std::cout << "Loading Way Data from file...";
-        while (std::getline(file, line)) 
+    // for long builds to poll, null without progress reporting
+    const std::atomic<bool>* getCancelFlag() const
+    {
+        return m_progress ? &m_progress->cancel : nullptr;
+    }
+
+    // number of threads used to parse the way file, defaults to all cores
+    void setNumThreads(size_t numThreads)
+    {
+        m_numThreads = std::max<size_t>(1, numThreads);
+    }
+
+    size_t getNumThreads() const
+    {
+        return m_numThreads;
+    }
+
+    void setNodeDedup(NodeDedup nodeDedup)
+    {
+        m_nodeDedup = nodeDedup;
+    }
+
+    // renumber nodes and ways along a hilbert curve after building the node data, on by default
+    void setSpatialOrder(bool spatialOrder)
+    {
+        m_spatialOrder = spatialOrder;
+    }
+
+    // sorts the nodes, and the ways by their middle vertex, along a hilbert curve over the map
+    // and remaps every node index, so that nodes and ways close on the map are close in memory
+    // the search graphs are not remapped, see buildSearchGraphs()
+    void reorderSpatially()
+    {
+        const HilbertCurve curve(getGraph().getPositions());
+        const std::vector<sf::Vector2f>& positions = getGraph().getPositions();
+
+        // the curve key goes in the upper half and the index in the lower half, so the sort reads
+        // its keys sequentially and the order falls out of the low bits
+        auto sortedOrder = [&](size_t count, auto key)
         {
-            Way way;
-            if (way.parseFromCSVLine(line))
+            std::vector<uint64_t> keyed(count);
+            parallelFor(m_numThreads, count, [&](size_t, size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++) { keyed[i] = (uint64_t(key(i)) << 32) | i; }
+            });
+            radixSort(keyed, [](uint64_t k) { return k >> 32; }, m_numThreads);
+
+            std::vector<uint32_t> order(count);
+            for (size_t i = 0; i < count; i++) { order[i] = uint32_t(keyed[i]); }
+            return order;
+        };
+
+        std::vector<uint32_t> order = sortedOrder(positions.size(), [&](size_t n) { return curve.key(positions[n]); });
+        std::vector<uint32_t> rank = m_nodeData.renumber(order);
+
+        std::vector<Way>& ways = m_wayData.getWays();
+        parallelFor(m_numThreads, ways.size(), [&](size_t, size_t begin, size_t end)
+        {
+            for (size_t w = begin; w < end; w++)
+            {
+                for (Node& vertex : ways[w].nodes) { vertex.index = rank[vertex.index]; }
+            }
+        }, 1024);
+
+        std::vector<uint32_t> wayOrder = sortedOrder(ways.size(), [&](size_t w)
+        {
+            return ways[w].nodes.empty() ? 0 : curve.key(ways[w].nodes[ways[w].nodes.size() / 2].p);
+        });
+
+        std::vector<Way> sortedWays(ways.size());
+        std::vector<uint32_t> wayRank(ways.size());
+        for (size_t w = 0; w < ways.size(); w++)
+        {
+            sortedWays[w] = std::move(ways[wayOrder[w]]);
+            sortedWays[w].index = w;
+            wayRank[wayOrder[w]] = uint32_t(w);
+        }
+        ways = std::move(sortedWays);
+        m_nodeData.getGraph().remapWays(wayRank);
+    }
+
+    // the speeds travel times are computed with, changes apply the next time the map is loaded,
+    // or right away with updateSpeeds()
+    SpeedTable& getSpeedTable()
+    {
+        return m_speedTable;
+    }
+
+    // derives every travel mode's view of the map from the way tags in one parallel pass over the
+    // ways: the directions each mode may use a way in, and its speed. the modes share the graph and
+    // the nodes, each only adds its directed edges, so switching between them costs nothing
+    void buildProfiles()
+    {
+        const std::array<std::vector<float>, NumTravelModes> waySpeeds = computeWayProfiles();
+
+        // the graph's own travel times are the car's
+        m_nodeData.getGraph().computeTravelTimes(waySpeeds[size_t(TravelMode::Car)]);
+        parallelFor(m_numThreads, NumTravelModes, [&](size_t, size_t begin, size_t end)
+        {
+            for (size_t m = begin; m < end; m++) { m_directedGraphs[m].build(getGraph(), m_wayDirections[m], waySpeeds[m]); }
+        }, 1);
+
+        std::cout << "Profiles:";
+        for (size_t m = 0; m < NumTravelModes; m++)
+        {
+            std::cout << " " << getTravelModeName(TravelMode(m)) << " " << m_directedGraphs[m].numEdges() << " edges" << (m + 1 < NumTravelModes ? "," : "\n");
+        }
+    }
+
+    // re-weights every travel mode after the speed table changed. the legal edges stay the same, so
+    // the overlay partitions are kept and only customized again, which is what makes this fast.
+    // overlays that were not built yet are left to buildRoutePlanner(), which sees the new weights.
+    // the hierarchies, landmarks and hub labels of a mode whose weights changed are dropped, since
+    // their distances no longer hold, it is up to the caller to build them again like the gui does
+    void updateSpeeds()
+    {
+        Timer timer;
+        const std::array<std::vector<float>, NumTravelModes> waySpeeds = computeWayProfiles();
+        m_nodeData.getGraph().computeTravelTimes(waySpeeds[size_t(TravelMode::Car)]);
+        for (size_t m = 0; m < NumTravelModes; m++)
+        {
+            if (!m_directedGraphs[m].setWeights(getGraph(), waySpeeds[m])) { continue; }
+            m_hierarchies[m].clear();
+            m_landmarks[m].clear();
+            m_hubLabels[m].clear();
+            if (!m_routePlanners[m].empty()) { m_routePlanners[m].customize(m_directedGraphs[m], m_numThreads); }
+        }
+        std::cout << "Updated speeds in " << timer.getElapsedSec() << "s\n";
+    }
+
+    // the directions each travel mode may use every way in, and its speed in meters per second
+    std::array<std::vector<float>, NumTravelModes> computeWayProfiles()
+    {
+        const std::vector<Way>& ways = m_wayData.getWays();
+        std::array<std::vector<float>, NumTravelModes> waySpeeds;
+        for (size_t m = 0; m < NumTravelModes; m++)
+        {
+            m_wayDirections[m].resize(ways.size());
+            waySpeeds[m].resize(ways.size());
+        }
+
+        // the tags are dictionary codes, so each distinct value is only looked up or parsed once per mode
+        const WayTagDictionary& dictionary = m_wayData.getTags();
+        auto perCode = [&](WayTag::Field field, auto value)
+        {
+            const StringDictionary& values = dictionary.getField(field);
+            std::vector<float> table(values.size());
+            for (uint32_t code = 0; code < values.size(); code++) { table[code] = float(value(values.decode(code))); }
+            return table;
+        };
+        std::array<std::vector<float>, NumTravelModes> highwaySpeeds;
+        for (size_t m = 0; m < NumTravelModes; m++)
+        {
+            const TravelMode mode = TravelMode(m);
+            highwaySpeeds[m] = perCode(WayTag::Highway, [&](std::string_view v)
             {
-                m_wayData.addWay(way);
+                return mode == TravelMode::Car ? m_speedTable.getHighwaySpeed(v) : m_speedTable.getSpeed(mode, v, {}, {});
+            });
+        }
+        const std::vector<float> maxSpeeds   = perCode(WayTag::MaxSpeed, [&](std::string_view v) { return SpeedTable::parseMaxSpeed(v); });
+        const std::vector<float> laneFactors = perCode(WayTag::Lanes,    [&](std::string_view v) { return m_speedTable.getLaneFactor(SpeedTable::parseLanes(v)); });
+
+        parallelFor(m_numThreads, ways.size(), [&](size_t, size_t begin, size_t end)
+        {
+            for (size_t w = begin; w < end; w++)
+            {
+                auto tag = [&](WayTag::Field field) { return std::string_view(getTag(ways[w], field)); };
+                AccessRules::WayTags tags{ tag(WayTag::Highway), tag(WayTag::OneWay), tag(WayTag::Junction), tag(WayTag::Access),
+                                           tag(WayTag::MotorVehicle), tag(WayTag::MotorCar), tag(WayTag::Bicycle), tag(WayTag::Foot) };
+                const uint32_t highway = ways[w].getTag(WayTag::Highway);
+                const float maxSpeed = maxSpeeds[ways[w].getTag(WayTag::MaxSpeed)];
+                for (size_t m = 0; m < NumTravelModes; m++)
+                {
+                    // as SpeedTable::getSpeed(), only cars follow speed limits and lanes
+                    float kmh = highwaySpeeds[m][highway];
+                    if (TravelMode(m) == TravelMode::Car) { kmh = (maxSpeed > 0 ? maxSpeed : kmh) * laneFactors[ways[w].getTag(WayTag::Lanes)]; }
+                    m_wayDirections[m][w] = AccessRules::getDirections(TravelMode(m), tags);
+                    waySpeeds[m][w] = std::max(kmh, 1.0f) / 3.6f;
+                }
             }
+        }, 1024);
+        return waySpeeds;
+    }
+
+    // the AccessRules::Direction bits of every way for a travel mode
+    const std::vector<uint8_t>& getWayDirections(TravelMode mode) const
+    {
+        return m_wayDirections[size_t(mode)];
+    }
+
+    const DirectedGraph& getDirectedGraph(TravelMode mode) const
+    {
+        return m_directedGraphs[size_t(mode)];
+    }
+
+    // also keep 1e-7 degree fixed point node positions in the graph, off by default
+    void setFixedPointPositions(bool fixedPointPositions)
+    {
+        m_fixedPointPositions = fixedPointPositions;
+        if (m_fixedPointPositions && getGraph().numNodes() > 0) { m_nodeData.getGraph().computeFixedPositions(); }
+    }
+
+    // replaces the node data with an already built one, used when loading from a map cache
+    // the ways and their tags have to be set first, the travel times are computed from them
+    void setNodeData(std::vector<Node>&& nodes, Graph&& graph)
+    {
+        m_nodeData.setNodes(std::move(nodes), std::move(graph));
+        if (m_fixedPointPositions) { m_nodeData.getGraph().computeFixedPositions(); }
+        buildSearchGraphs();
+    }
+
+    // the directed graphs of every travel mode, derived from the graph and the way tags
+    // has to be called again after the graph changes, e.g. after reorderSpatially()
+    // the overlays, hierarchies, landmarks and hub labels built from the old graphs are dropped,
+    // they take seconds to minutes on large maps, so building them again is left to the caller
+    void buildSearchGraphs()
+    {
+        for (ContractionHierarchy& hierarchy : m_hierarchies) { hierarchy.clear(); }
+        for (Landmarks& landmarks : m_landmarks) { landmarks.clear(); }
+        for (HubLabels& labels : m_hubLabels) { labels.clear(); }
+        for (CustomizableRoutePlanner& planner : m_routePlanners) { planner.clear(); }
+        buildProfiles();
+    }
+
+    // partitions a travel mode's graph into cells and customizes its overlay, which takes a few
+    // seconds on large maps, so the gui does it on its worker thread once the map is shown.
+    // unlike the hierarchies the overlays are not kept on disk
+    void buildRoutePlanner(TravelMode mode)
+    {
+        if (m_progress) { m_progress->stage = "Customizing overlay"; }
+
+        Timer timer;
+        CustomizableRoutePlanner& planner = m_routePlanners[size_t(mode)];
+        planner.build(getGraph(), getDirectedGraph(mode));
+        const double partitionSec = timer.getElapsedSec();
+        timer.start();
+        planner.customize(getDirectedGraph(mode), m_numThreads, getCancelFlag());
+        if (isCancelled()) { planner.clear(); return; }
+        std::cout << "Overlay " << getTravelModeName(mode) << ": " << planner.numLevels() << " levels, " << planner.numCliqueEdges()
+                  << " clique edges, " << planner.getMemoryBytes() / (1024.0 * 1024.0) << " MB, partitioned in " << partitionSec
+                  << "s, customized in " << timer.getElapsedSec() << "s\n";
+    }
+
+    void buildRoutePlanners()
+    {
+        for (size_t m = 0; m < NumTravelModes; m++) { buildRoutePlanner(TravelMode(m)); }
+    }
+
+    const CustomizableRoutePlanner& getRoutePlanner(TravelMode mode) const
+    {
+        return m_routePlanners[size_t(mode)];
+    }
+
+    CustomizableRoutePlanner& getRoutePlanner(TravelMode mode)
+    {
+        return m_routePlanners[size_t(mode)];
+    }
+
+    // contracts the directed graph of a travel mode, which takes seconds on large maps, so it is
+    // left to the caller, MapCache::loadHierarchy() keeps the result next to the map file
+    void buildHierarchy(TravelMode mode)
+    {
+        Timer timer;
+        ContractionHierarchy& hierarchy = m_hierarchies[size_t(mode)];
+        hierarchy.build(getDirectedGraph(mode), getGraph().numNodes(), m_numThreads, getCancelFlag());
+        if (isCancelled()) { return; }
+        std::cout << "Contraction hierarchy " << getTravelModeName(mode) << ": " << hierarchy.numShortcuts() << " shortcuts, "
+                  << hierarchy.getMemoryBytes() / (1024.0 * 1024.0) << " MB, built in " << timer.getElapsedSec() << "s\n";
+    }
+
+    ContractionHierarchy& getHierarchy(TravelMode mode)
+    {
+        return m_hierarchies[size_t(mode)];
+    }
+
+    const ContractionHierarchy& getHierarchy(TravelMode mode) const
+    {
+        return m_hierarchies[size_t(mode)];
+    }
+
+    // selects the landmarks of a travel mode and computes their distance tables, one search per
+    // landmark and direction, MapCache::loadLandmarks() keeps the result next to the map file
+    void buildLandmarks(TravelMode mode, size_t count = Landmarks::DefaultCount, Landmarks::Selection selection = Landmarks::Selection::Avoid)
+    {
+        Timer timer;
+        Landmarks& landmarks = m_landmarks[size_t(mode)];
+        landmarks.build(getDirectedGraph(mode), getGraph().numNodes(), count, selection, m_numThreads, getCancelFlag());
+        if (isCancelled()) { return; }
+        std::cout << "Landmarks " << getTravelModeName(mode) << ": " << landmarks.size() << " landmarks, "
+                  << landmarks.getMemoryBytes() / (1024.0 * 1024.0) << " MB, built in " << timer.getElapsedSec() << "s\n";
+    }
+
+    Landmarks& getLandmarks(TravelMode mode)
+    {
+        return m_landmarks[size_t(mode)];
+    }
+
+    const Landmarks& getLandmarks(TravelMode mode) const
+    {
+        return m_landmarks[size_t(mode)];
+    }
+
+    // the hub labels of a travel mode, from its contraction hierarchy, which has to be built or loaded
+    // first. the labels take far more memory than the hierarchy, so they are only built when asked
+    // for, MapCache::loadHubLabels() keeps them next to the map file
+    void buildHubLabels(TravelMode mode)
+    {
+        Timer timer;
+        HubLabels& labels = m_hubLabels[size_t(mode)];
+        labels.build(getHierarchy(mode), m_numThreads, getCancelFlag());
+        if (isCancelled()) { return; }
+        std::cout << "Hub labels " << getTravelModeName(mode) << ": " << labels.averageLabelSize() << " hubs per label, "
+                  << labels.getLabelBytes() / (1024.0 * 1024.0) << " MB, built in " << timer.getElapsedSec() << "s\n";
+    }
+
+    HubLabels& getHubLabels(TravelMode mode)
+    {
+        return m_hubLabels[size_t(mode)];
+    }
+
+    const HubLabels& getHubLabels(TravelMode mode) const
+    {
+        return m_hubLabels[size_t(mode)];
+    }
+
+    void loadFromFile(const std::string& filename) 
+    {
+        // the whole file is memory mapped and tokenized in place, which avoids
+        // the per line and per field string allocations of std::getline
+        MappedFile file(filename);
+        if (!file.isOpen())
+        {
+            std::cout << "Could not open map file: " << filename << "\n";
+            return;
+        }
+
+        if (file.size() == 0) { return; }
+
+        if (m_progress)
+        {
+            m_progress->stage = "Parsing ways";
+            m_progress->totalBytes = file.size();
         }
 
+        // gzip and zstd files are decompressed on the fly, straight into the parser
+        DecompressingReader::Format format = DecompressingReader::detect(file.data(), file.size());
+
+        std::cout << "Loading Way Data from file...";
+        Timer timer;
+        size_t parsedBytes = (format == DecompressingReader::None) ? parseMappedFile(file) : parseCompressedFile(file, format);
+        double seconds = timer.getElapsedSec();
+
+        if (isCancelled()) { std::cout << " cancelled\n"; return; }
+        double megabytes = double(parsedBytes) / (1024.0 * 1024.0);
+
         m_wayData.createVectorizedData();
-        std::cout << " " << m_wayData.getWays().size() << " ways\n";
+        size_t numWays = m_wayData.getWays().size();
+        std::cout << " " << numWays << " ways";
+        std::cout << " (" << megabytes << " MB " << DecompressingReader::getFormatName(format) << " in " << seconds << "s, " << (megabytes / std::max(seconds, 1e-9)) << " MB/s, " << (double(numWays) / std::max(seconds, 1e-9)) << " ways/s)\n";
         
-        for (auto& way : m_wayData.getWays())
+        buildNodeData();
+    }
+
+    // parses an uncompressed mapped file in place, returns the number of bytes parsed
+    size_t parseMappedFile(const MappedFile& file)
+    {
+        const char* begin = file.data();
+        const char* end   = file.data() + file.size();
+
+        // skip header
+        begin = nextLine(begin, end);
+        if (m_progress) { m_progress->bytesParsed = size_t(begin - file.data()); }
+
+        parseWays(begin, end);
+        return file.size();
+    }
+
+    // parses a compressed file block by block while the next blocks are decompressed on
+    // another thread, returns the number of decompressed bytes parsed
+    // only a line split across two blocks is ever copied, everything else is parsed in place
+    size_t parseCompressedFile(const MappedFile& file, DecompressingReader::Format format)
+    {
+        // each block is split across all parsing threads, so give each thread a decent chunk
+        const size_t blockSize = std::max<size_t>(4 << 20, m_numThreads * (1 << 20));
+
+        DecompressingReader reader;
+        if (!reader.start(file.data(), file.size(), format, blockSize))
         {
-            for (size_t i = 0; i < way.nodes.size(); i++)
+            std::cout << " " << reader.getError() << "\n";
+            return 0;
+        }
+
+        std::vector<char> block;
+        std::string carry;
+        bool skipHeader = true;
+        size_t parsedBytes = 0;
+
+        // parses one complete line that was assembled from several blocks
+        auto parseCarry = [&]()
+        {
+            if (!skipHeader) { parseWays(carry.data(), carry.data() + carry.size(), false); }
+            skipHeader = false;
+            carry.clear();
+        };
+
+        while (reader.next(block))
+        {
+            if (isCancelled()) { return parsedBytes; }
+            parsedBytes += block.size();
+
+            const char* begin = block.data();
+            const char* end   = block.data() + block.size();
+
+            // the first line of the block completes the line carried over from the last block
+            const char* firstLineEnd = static_cast<const char*>(std::memchr(begin, '\n', block.size()));
+            if (!firstLineEnd)
             {
-                Node& n = way.nodes[i];
+                carry.append(begin, end);
+                continue;
+            }
+
+            carry.append(begin, firstLineEnd);
+            parseCarry();
+            begin = firstLineEnd + 1;
+
+            // the unfinished line at the end of the block is carried over to the next one
+            const char* linesEnd = end;
+            while (linesEnd > begin && linesEnd[-1] != '\n') { linesEnd--; }
+
+            parseWays(begin, linesEnd, false);
+            carry.assign(linesEnd, end);
+
+            if (m_progress) { m_progress->bytesParsed = reader.getCompressedBytesRead(); }
+        }
 
-                // compute the connected nodes from this node
-                if (i > 0) { n.connectedNodeIDs.push_back(way.nodes[i - 1].id); }
-                if (i < way.nodes.size() - 1) { n.connectedNodeIDs.push_back(way.nodes[i + 1].id); }
+        // a last line without a trailing newline, unless the stream was cut off in the middle of it
+        std::string error = reader.getError();
+        if (!error.empty()) { std::cout << " " << DecompressingReader::getFormatName(format) << " error: " << error << ","; }
+        else if (!carry.empty()) { parseCarry(); }
 
-                m_nodeData.addNode(n);
+        if (m_progress) { m_progress->bytesParsed = file.size(); }
+        return parsedBytes;
+    }
+
+    // returns a pointer to the first character after the end of the line starting at pos
+    static const char* nextLine(const char* pos, const char* end)
+    {
+        const char* newline = static_cast<const char*>(std::memchr(pos, '\n', size_t(end - pos)));
+        return newline ? newline + 1 : end;
+    }
+
+    // parses every line in [begin, end) as a way and adds it to the way data
+    // the range is split into newline aligned chunks which are parsed in parallel
+    // countBytes is false when the progress is tracked in compressed bytes instead
+    void parseWays(const char* begin, const char* end, bool countBytes = true)
+    {
+        // small files are not worth the thread startup cost
+        const size_t minChunkBytes = 1 << 20;
+        size_t numChunks = std::min(m_numThreads, std::max<size_t>(1, size_t(end - begin) / minChunkBytes));
+
+        // chunk boundaries always fall on the first character of a line
+        std::vector<const char*> bounds(numChunks + 1, end);
+        bounds[0] = begin;
+        for (size_t i = 1; i < numChunks; i++)
+        {
+            const char* split = begin + (end - begin) * i / numChunks;
+            bounds[i] = std::max(bounds[i - 1], nextLine(split - 1, end));
+        }
+
+        // each chunk encodes its tags into its own dictionary, which is merged afterwards
+        std::vector<std::vector<Way>> chunkWays(numChunks);
+        std::vector<WayTagDictionary> chunkTags(numChunks);
+        if (numChunks == 1)
+        {
+            parseChunk(begin, end, chunkWays[0], chunkTags[0], m_progress, countBytes);
+        }
+        else
+        {
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < numChunks; i++)
+            {
+                threads.emplace_back([&, i]() { parseChunk(bounds[i], bounds[i + 1], chunkWays[i], chunkTags[i], m_progress, countBytes); });
             }
+            for (auto& t : threads) { t.join(); }
         }
 
-        m_nodeData.createVectorizedData();
-        std::cout << " " << m_nodeData.getNodes().size() << " unique nodes\n";
+        // merge the chunks in file order so the result never depends on the thread count
+        // the chunk dictionaries are merged in order too, so the tag codes are always
+        // numbered by first appearance in the file
+        for (size_t c = 0; c < numChunks; c++)
+        {
+            std::vector<std::vector<uint32_t>> remap = m_wayData.getTags().merge(chunkTags[c]);
+            for (auto& way : chunkWays[c])
+            {
+                for (size_t f = 0; f < WayTag::Count; f++) { way.tags[f] = remap[f][way.tags[f]]; }
+                m_wayData.addWay(std::move(way));
+            }
+
+            // the moved-from shells of the chunk are released before the next chunk is merged
+            chunkWays[c] = std::vector<Way>();
+        }
+    }
+
+    // parses every line in [begin, end) into a local way buffer, safe to call from any thread
+    // if progress is given, the parsed geometry is also published to it in batches
+    static void parseChunk(const char* begin, const char* end, std::vector<Way>& ways, WayTagDictionary& tags,
+                           LoadProgress* progress = nullptr, bool countBytes = true)
+    {
+        const size_t batchSize = 4096;
+        std::vector<PreviewWay> batch;
+        const char* published = begin;
+
+        const char* pos = begin;
+        while (pos < end)
+        {
+            if (progress && progress->cancel) { return; }
+
+            const char* lineEnd = static_cast<const char*>(std::memchr(pos, '\n', size_t(end - pos)));
+            if (!lineEnd) { lineEnd = end; }
+
+            Way way;
+            if (way.parseFromCSV(std::string_view(pos, size_t(lineEnd - pos)), tags))
+            {
+                if (progress)
+                {
+                    PreviewWay& preview = batch.emplace_back();
+                    preview.highway = tags.decode(WayTag::Highway, way.getTag(WayTag::Highway));
+                    for (const Node& n : way.nodes) { preview.points.push_back(n.p); }
+                }
+
+                ways.push_back(std::move(way));
+            }
+
+            pos = (lineEnd < end) ? lineEnd + 1 : end;
+
+            if (progress && batch.size() == batchSize)
+            {
+                progress->publish(batch, countBytes ? size_t(pos - published) : 0);
+                published = pos;
+            }
+        }
+
+        if (progress) { progress->publish(batch, countBytes ? size_t(end - published) : 0); }
+    }
+
+    // builds the shared nodes from the way vertices, with the hash table or the parallel sort
+    void buildNodeData()
+    {
+        if (m_progress) { m_progress->stage = "Building nodes"; }
+
+        size_t numWayNodes = 0;
+        for (const auto& way : m_wayData.getWays()) { numWayNodes += way.nodes.size(); }
+
+        m_nodeData = NodeData();
+        bool sorted = m_nodeDedup == NodeDedup::Sort || (m_nodeDedup == NodeDedup::Auto && m_numThreads > 1 && numWayNodes >= SortDedupMinVertices);
+        if (sorted)
+        {
+            std::cout << "Processing Node Data (parallel sort)...";
+            m_nodeData.buildSorted(m_wayData.getWays(), m_numThreads);
+        }
+        else
+        {
+            std::cout << "Processing Node Data...";
+            m_nodeData.reserve(numWayNodes);
+
+            // the way keeps its own vertex with the index of the shared node
+            for (auto& way : m_wayData.getWays())
+            {
+                for (Node& n : way.nodes) { n.index = m_nodeData.addNode(n); }
+            }
+
+            m_nodeData.buildGraph(m_wayData.getWays());
+        }
+
+        if (m_fixedPointPositions) { m_nodeData.getGraph().computeFixedPositions(); }
+
+        std::cout << " " << m_nodeData.getNodes().size() << " unique nodes, " << getGraph().numEdges() << " edges, peak RSS " << MemoryUsage::toMB(MemoryUsage::getPeakRSS()) << " MB\n";
+
+        if (m_spatialOrder)
+        {
+            Timer timer;
+            reorderSpatially();
+            std::cout << "Nodes and ways renumbered along a hilbert curve in " << timer.getElapsedMillis() << "ms\n";
+        }
+
+        buildSearchGraphs();
     }
 
     std::vector<Way>& getWays()
@@ -248,4 +1145,19 @@ public:
     {
         return m_nodeData;
     }
+
+    const Graph& getGraph() const
+    {
+        return m_nodeData.getGraph();
+    }
+
+    WayData& getWayData()
+    {
+        return m_wayData;
+    }
+
+    const std::string& getTag(const Way& way, WayTag::Field field) const
+    {
+        return m_wayData.getTag(way, field);
+    }
 };
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// writes filename through a temporary file next to it, which only replaces filename once every
+// byte was written and flushed, so a crash or a full disk never leaves a truncated file behind.
+// write is called with the open stream, the stream's state afterwards decides if the file is kept
+template <class WriteFunction>
+inline bool writeFileAtomically(const std::string& filename, WriteFunction write)
+{
+    const std::string tempFile = filename + ".tmp";
+    {
+        std::ofstream out(tempFile, std::ios::binary | std::ios::trunc);
+        if (!out) { return false; }
+
+        write(out);
+        out.close();
+        if (!out) { std::remove(tempFile.c_str()); return false; }
+    }
+
+    // rename does not replace an existing file on windows
+    std::remove(filename.c_str());
+    if (std::rename(tempFile.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(tempFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+// read-only memory mapping of an entire file
+// the contents can be tokenized in place without copying them into strings
+class MappedFile
+{
+    const char* m_data = nullptr;
+    size_t      m_size = 0;
+    bool        m_open = false;
+
+#ifdef _WIN32
+    HANDLE      m_file = INVALID_HANDLE_VALUE;
+    HANDLE      m_mapping = nullptr;
+#else
+    int         m_fd = -1;
+#endif
+
+public:
+
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& filename)
+    {
+        open(filename);
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& filename)
+    {
+        close();
+
+#ifdef _WIN32
+        m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) { return false; }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size)) { close(); return false; }
+        m_size = size_t(size.QuadPart);
+
+        // an empty file cannot be mapped, but it is still a valid (empty) file
+        if (m_size > 0)
+        {
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!m_mapping) { close(); return false; }
+
+            m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+            if (!m_data) { close(); return false; }
+        }
+#else
+        m_fd = ::open(filename.c_str(), O_RDONLY);
+        if (m_fd == -1) { return false; }
+
+        struct stat st;
+        if (fstat(m_fd, &st) != 0) { close(); return false; }
+        m_size = size_t(st.st_size);
+
+        // an empty file cannot be mapped, but it is still a valid (empty) file
+        if (m_size > 0)
+        {
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+            if (data == MAP_FAILED) { close(); return false; }
+
+            // we parse front to back, so let the kernel read ahead aggressively
+            madvise(data, m_size, MADV_SEQUENTIAL);
+            m_data = static_cast<const char*>(data);
+        }
+#endif
+
+        m_open = true;
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (m_data) { UnmapViewOfFile(m_data); }
+        if (m_mapping) { CloseHandle(m_mapping); }
+        if (m_file != INVALID_HANDLE_VALUE) { CloseHandle(m_file); }
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data) { munmap(const_cast<char*>(m_data), m_size); }
+        if (m_fd != -1) { ::close(m_fd); }
+        m_fd = -1;
+#endif
+        m_data = nullptr;
+        m_size = 0;
+        m_open = false;
+    }
+
+    bool isOpen() const
+    {
+        return m_open;
+    }
+
+    const char* data() const
+    {
+        return m_data;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <psapi.h>
+    #pragma comment(lib, "psapi.lib")
+#elif !defined(__linux__)
+    #include <sys/resource.h>
+#endif
+
+// resident memory of the whole process, used to report the memory cost of loading a map
+class MemoryUsage
+{
+public:
+
+    // the largest amount of physical memory the process has used so far, in bytes
+    static size_t getPeakRSS()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters{};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) { return 0; }
+        return size_t(counters.PeakWorkingSetSize);
+#elif defined(__linux__)
+        return readStatus("VmHWM:");
+#else
+        // macOS reports ru_maxrss in bytes
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return size_t(usage.ru_maxrss);
+#endif
+    }
+
+    // starts tracking the peak from the current usage again, so separate loads can be measured
+    // only linux supports this, elsewhere the peak always covers the whole process lifetime
+    static bool resetPeakRSS()
+    {
+#if defined(__linux__)
+        std::ofstream clearRefs("/proc/self/clear_refs");
+        clearRefs << "5";
+        return bool(clearRefs.flush());
+#else
+        return false;
+#endif
+    }
+
+    static double toMB(size_t bytes)
+    {
+        return double(bytes) / (1024.0 * 1024.0);
+    }
+
+private:
+
+#if defined(__linux__)
+    // reads a "Name:   1234 kB" line of /proc/self/status
+    static size_t readStatus(const std::string& name)
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.compare(0, name.size(), name) == 0) { return size_t(std::stoull(line.substr(name.size()))) * 1024; }
+        }
+        return 0;
+    }
+#endif
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "Graph.hpp"
+#include "DirectedGraph.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// nested cells over the nodes of one travel mode, for the overlay searches of CustomizableRoutePlanner
+//
+// the nodes are split in half across the wider side of their bounding box, at the median node,
+// until each part holds at most the cell size of the top level. each top cell is split further
+// into the cells of the level below, so every cell lies inside exactly one cell of each level above
+// the split only looks at positions, never at weights, so it stays valid however the roads are weighted
+class MultilevelPartition
+{
+public:
+
+    static constexpr uint32_t None = UINT32_MAX;
+
+private:
+
+    size_t                  m_numLevels = 0;
+    std::vector<uint32_t>   m_cells;        // the cell of every node on every level, level 0 is the finest, None for nodes without legal edges
+    std::vector<uint32_t>   m_numCells;
+
+public:
+
+    // the most nodes a cell of each level may hold, from the finest level up
+    static std::vector<uint32_t> defaultCellSizes()
+    {
+        return { 256, 2048, 16384 };
+    }
+
+    bool empty() const
+    {
+        return m_numLevels == 0;
+    }
+
+    size_t numLevels() const
+    {
+        return m_numLevels;
+    }
+
+    uint32_t numCells(size_t level) const
+    {
+        return m_numCells[level];
+    }
+
+    uint32_t cell(size_t level, uint32_t node) const
+    {
+        return m_cells[size_t(node) * m_numLevels + level];
+    }
+
+    // the highest level on which the two nodes are in different cells, -1 if they share a finest cell
+    int crossingLevel(uint32_t a, uint32_t b) const
+    {
+        if (m_numLevels == 0) { return -1; }
+        const uint32_t* cellsA = &m_cells[size_t(a) * m_numLevels];
+        const uint32_t* cellsB = &m_cells[size_t(b) * m_numLevels];
+        for (int level = int(m_numLevels) - 1; level >= 0; level--)
+        {
+            if (cellsA[level] != cellsB[level]) { return level; }
+        }
+        return -1;
+    }
+
+    void clear()
+    {
+        *this = MultilevelPartition();
+    }
+
+    size_t getMemoryBytes() const
+    {
+        return (m_cells.capacity() + m_numCells.capacity()) * sizeof(uint32_t);
+    }
+
+    // levels whose cells would hold the whole graph are left out, they would have no boundary
+    void build(const Graph& graph, const DirectedGraph& directed, const std::vector<uint32_t>& cellSizes)
+    {
+        clear();
+
+        const size_t numNodes = graph.numNodes();
+        std::vector<uint32_t> nodes;
+        for (uint32_t n = 0; n < numNodes; n++)
+        {
+            if (directed.forward().beginEdge(n) < directed.forward().endEdge(n) || directed.reverse().beginEdge(n) < directed.reverse().endEdge(n))
+            {
+                nodes.push_back(n);
+            }
+        }
+
+        std::vector<uint32_t> sizes;
+        for (uint32_t size : cellSizes) { if (size < nodes.size()) { sizes.push_back(size); } }
+        if (sizes.empty()) { return; }
+
+        m_numLevels = sizes.size();
+        m_cells.assign(numNodes * m_numLevels, None);
+        m_numCells.assign(m_numLevels, 0);
+        split(graph, nodes.begin(), nodes.end(), int(m_numLevels) - 1, sizes);
+    }
+
+private:
+
+    using Iterator = std::vector<uint32_t>::iterator;
+
+    void split(const Graph& graph, Iterator begin, Iterator end, int level, const std::vector<uint32_t>& sizes)
+    {
+        if (size_t(end - begin) <= sizes[level])
+        {
+            const uint32_t cell = m_numCells[level]++;
+            for (Iterator it = begin; it != end; ++it) { m_cells[size_t(*it) * m_numLevels + level] = cell; }
+            if (level > 0) { split(graph, begin, end, level - 1, sizes); }
+            return;
+        }
+
+        // east west distances shrink towards the poles, so compare the sides at the map's scale
+        sf::Vector2f min = graph.position(*begin), max = min;
+        for (Iterator it = begin; it != end; ++it)
+        {
+            const sf::Vector2f& p = graph.position(*it);
+            min.x = std::min(min.x, p.x); min.y = std::min(min.y, p.y);
+            max.x = std::max(max.x, p.x); max.y = std::max(max.y, p.y);
+        }
+        const bool splitX = (max.x - min.x) * graph.getMinCosLatitude() > (max.y - min.y);
+
+        Iterator middle = begin + (end - begin) / 2;
+        std::nth_element(begin, middle, end, [&](uint32_t a, uint32_t b)
+        {
+            return splitX ? graph.position(a).x < graph.position(b).x : graph.position(a).y < graph.position(b).y;
+        });
+        split(graph, begin, middle, level, sizes);
+        split(graph, middle, end, level, sizes);
+    }
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// coordinates of osm nodes by id, used by the osm importers to resolve the node references of ways
+// it is a flat array of 16 byte entries sorted by id, so its size only depends on the number of
+// nodes, and since osm files list nodes in id order it normally never has to be sorted at all
+class NodeIndex
+{
+public:
+
+    struct Entry
+    {
+        int64_t id;
+        float   lat;
+        float   lon;
+    };
+
+private:
+
+    std::vector<Entry>  m_entries;
+    bool                m_sorted = true;
+
+public:
+
+    void add(int64_t id, float lat, float lon)
+    {
+        if (!m_entries.empty() && id < m_entries.back().id) { m_sorted = false; }
+        m_entries.push_back({ id, lat, lon });
+    }
+
+    // callers appending many batches should reserve() their total once, the vector grows geometrically otherwise
+    void reserve(size_t count)
+    {
+        m_entries.reserve(count);
+    }
+
+    void append(const std::vector<Entry>& entries)
+    {
+        for (const Entry& e : entries) { add(e.id, e.lat, e.lon); }
+    }
+
+    // must be called after adding nodes and before find(), does nothing if the ids arrived in order
+    // the sort is stable, so the first of several nodes with the same id is the one that is found
+    void sort()
+    {
+        if (m_sorted) { return; }
+
+        std::stable_sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) { return a.id < b.id; });
+        m_sorted = true;
+    }
+
+    // the node with the given id, or nullptr if it is not in the index
+    const Entry* find(int64_t id) const
+    {
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), id, [](const Entry& e, int64_t value) { return e.id < value; });
+        return (it != m_entries.end() && it->id == id) ? &*it : nullptr;
+    }
+
+    size_t size() const
+    {
+        return m_entries.size();
+    }
+
+    size_t getMemoryBytes() const
+    {
+        return m_entries.capacity() * sizeof(Entry);
+    }
+};
@@ -0,0 +1,510 @@
+#pragma once
+
+#include "MapData.hpp"
+#include "MappedFile.hpp"
+#include "NodeIndex.hpp"
+#include "Timer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef NLMAP_WITH_ZLIB
+    #include <zlib.h>
+#endif
+
+#ifdef NLMAP_WITH_ZSTD
+    #include <zstd.h>
+#endif
+
+// reads an OpenStreetMap .osm.pbf file straight into MapData, with no csv conversion step
+//
+// the file is a sequence of independently compressed blobs, which are decoded in parallel
+// only ways with a highway tag are kept, with only the tags the Way struct models, and
+// their node references are resolved to coordinates from the nodes in the same file
+// the result is merged in file order, so it never depends on the number of threads
+class OSMPBFReader
+{
+    // minimal reader for the protobuf wire format, throws std::runtime_error on malformed data
+    class ProtoReader
+    {
+        const uint8_t*  m_pos;
+        const uint8_t*  m_end;
+        uint32_t        m_wireType = 0;
+
+    public:
+
+        explicit ProtoReader(std::string_view data)
+            : m_pos(reinterpret_cast<const uint8_t*>(data.data()))
+            , m_end(reinterpret_cast<const uint8_t*>(data.data()) + data.size())
+        {
+        }
+
+        // reads the key of the next field, returns false at the end of the message
+        bool next(uint32_t& field)
+        {
+            if (m_pos >= m_end) { return false; }
+
+            uint64_t key = varint();
+            field = uint32_t(key >> 3);
+            m_wireType = uint32_t(key & 7);
+            return true;
+        }
+
+        uint64_t varint()
+        {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                if (m_pos >= m_end) { break; }
+
+                uint8_t b = *m_pos++;
+                value |= uint64_t(b & 0x7f) << shift;
+                if (!(b & 0x80)) { return value; }
+            }
+
+            throw std::runtime_error("bad varint");
+        }
+
+        // zigzag encoded signed varint
+        int64_t svarint()
+        {
+            uint64_t v = varint();
+            return int64_t(v >> 1) ^ -int64_t(v & 1);
+        }
+
+        std::string_view bytes()
+        {
+            uint64_t length = varint();
+            if (length > uint64_t(m_end - m_pos)) { throw std::runtime_error("bad length"); }
+
+            std::string_view data(reinterpret_cast<const char*>(m_pos), size_t(length));
+            m_pos += length;
+            return data;
+        }
+
+        // reads a repeated varint field, which may or may not be packed
+        template <class T, bool Signed>
+        void repeated(std::vector<T>& values)
+        {
+            if (m_wireType != 2)
+            {
+                values.push_back(T(Signed ? svarint() : int64_t(varint())));
+                return;
+            }
+
+            ProtoReader packed(bytes());
+            while (packed.m_pos < packed.m_end)
+            {
+                values.push_back(T(Signed ? packed.svarint() : int64_t(packed.varint())));
+            }
+        }
+
+        void skip()
+        {
+            switch (m_wireType)
+            {
+                case 0: varint(); break;
+                case 1: advance(8); break;
+                case 2: bytes(); break;
+                case 5: advance(4); break;
+                default: throw std::runtime_error("bad wire type");
+            }
+        }
+
+    private:
+
+        void advance(size_t n)
+        {
+            if (n > size_t(m_end - m_pos)) { throw std::runtime_error("truncated field"); }
+            m_pos += n;
+        }
+    };
+
+    // everything a single data blob decodes to
+    struct BlockResult
+    {
+        std::vector<NodeIndex::Entry> nodes;
+        std::vector<Way>        ways;
+        std::vector<size_t>     refOffsets{ 0 };    // per way + 1, into refs
+        std::vector<int64_t>    refs;
+        WayTagDictionary        tags;
+        std::string             error;
+    };
+
+public:
+
+    static bool isPBF(const std::string& filename)
+    {
+        return filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".pbf") == 0;
+    }
+
+    static void load(MapData& map, const std::string& filename)
+    {
+        MappedFile file(filename);
+        if (!file.isOpen())
+        {
+            std::cout << "Could not open map file: " << filename << "\n";
+            return;
+        }
+
+        LoadProgress* progress = map.getProgress();
+        if (progress)
+        {
+            progress->stage = "Decoding PBF blocks";
+            progress->totalBytes = file.size();
+        }
+
+        std::cout << "Loading Way Data from PBF file...";
+        Timer timer;
+
+        std::vector<std::string_view> blobs;
+        if (!findDataBlobs(file, blobs)) { std::cout << " not a valid PBF file\n"; return; }
+
+        // decode every blob in parallel, each thread takes the next undecoded blob
+        std::vector<BlockResult> blocks(blobs.size());
+        std::atomic<size_t> nextBlob = 0;
+        auto decodeBlobs = [&]()
+        {
+            for (size_t b = nextBlob++; b < blobs.size(); b = nextBlob++)
+            {
+                if (map.isCancelled()) { return; }
+
+                try { decodeBlob(blobs[b], blocks[b]); }
+                catch (const std::exception& e) { blocks[b].error = e.what(); }
+
+                if (progress) { progress->bytesParsed += blobs[b].size(); }
+            }
+        };
+
+        runThreads(map.getNumThreads(), decodeBlobs);
+        if (map.isCancelled()) { std::cout << " cancelled\n"; return; }
+
+        for (const BlockResult& block : blocks)
+        {
+            if (!block.error.empty()) { std::cout << " PBF error: " << block.error << "\n"; return; }
+        }
+
+        if (progress) { progress->stage = "Resolving way nodes"; }
+
+        // the node index is every node of the file sorted by id, already sorted for most files
+        NodeIndex nodes;
+        size_t numNodes = 0;
+        for (const BlockResult& block : blocks) { numNodes += block.nodes.size(); }
+        nodes.reserve(numNodes);
+        for (BlockResult& block : blocks)
+        {
+            nodes.append(block.nodes);
+            block.nodes = std::vector<NodeIndex::Entry>();
+        }
+        nodes.sort();
+
+        // resolve node references to coordinates in parallel, references to nodes that are
+        // not in the file (clipped at the edge of an extract) are dropped
+        std::atomic<size_t> nextBlock = 0;
+        auto resolveWays = [&]()
+        {
+            for (size_t b = nextBlock++; b < blocks.size(); b = nextBlock++)
+            {
+                BlockResult& block = blocks[b];
+                for (size_t w = 0; w < block.ways.size(); w++)
+                {
+                    Way& way = block.ways[w];
+                    for (size_t r = block.refOffsets[w]; r < block.refOffsets[w + 1]; r++)
+                    {
+                        const NodeIndex::Entry* node = nodes.find(block.refs[r]);
+                        if (!node) { continue; }
+
+                        // the same rotation as the csv loader to match the sfml drawing direction
+                        way.nodes.push_back(Node(node->lon, -node->lat));
+                    }
+                    way.count = int(way.nodes.size());
+                }
+            }
+        };
+
+        runThreads(map.getNumThreads(), resolveWays);
+
+        // merge in file order, exactly like the chunks of the csv loader
+        WayData& wayData = map.getWayData();
+        for (BlockResult& block : blocks)
+        {
+            std::vector<std::vector<uint32_t>> remap = wayData.getTags().merge(block.tags);
+            for (Way& way : block.ways)
+            {
+                if (way.nodes.empty()) { continue; }
+
+                for (size_t f = 0; f < WayTag::Count; f++) { way.tags[f] = remap[f][way.tags[f]]; }
+                wayData.addWay(std::move(way));
+            }
+            block.ways = std::vector<Way>();
+        }
+
+        double seconds = timer.getElapsedSec();
+        double megabytes = double(file.size()) / (1024.0 * 1024.0);
+
+        wayData.createVectorizedData();
+        size_t numWays = wayData.getWays().size();
+        std::cout << " " << numWays << " ways (" << megabytes << " MB pbf in " << seconds << "s, "
+                  << (megabytes / std::max(seconds, 1e-9)) << " MB/s, " << (double(numWays) / std::max(seconds, 1e-9)) << " ways/s)\n";
+
+        map.buildNodeData();
+    }
+
+    // returns the uncompressed contents of a blob, using storage if it had to be decompressed
+    // the Blob message of fileformat.proto: raw = 1, raw_size = 2, zlib_data = 3, zstd_data = 7
+    static std::string_view decompressBlob(std::string_view blob, std::vector<char>& storage)
+    {
+        ProtoReader reader(blob);
+        std::string_view raw, zlibData, zstdData;
+        uint64_t rawSize = 0;
+
+        uint32_t field;
+        while (reader.next(field))
+        {
+            if      (field == 1) { raw = reader.bytes(); }
+            else if (field == 2) { rawSize = reader.varint(); }
+            else if (field == 3) { zlibData = reader.bytes(); }
+            else if (field == 7) { zstdData = reader.bytes(); }
+            else                 { reader.skip(); }
+        }
+
+        if (!raw.empty()) { return raw; }
+
+        // the uncompressed size of a blob is capped at 32 MB by the format
+        if (rawSize > (32u << 20)) { throw std::runtime_error("blob too large"); }
+        storage.resize(size_t(rawSize));
+
+        if (!zlibData.empty())
+        {
+#ifdef NLMAP_WITH_ZLIB
+            uLongf size = uLongf(rawSize);
+            if (uncompress(reinterpret_cast<Bytef*>(storage.data()), &size, reinterpret_cast<const Bytef*>(zlibData.data()), uLong(zlibData.size())) != Z_OK || size != rawSize)
+            {
+                throw std::runtime_error("corrupt zlib blob");
+            }
+            return std::string_view(storage.data(), storage.size());
+#else
+            throw std::runtime_error("zlib compressed blobs require building with NLMAP_WITH_ZLIB");
+#endif
+        }
+
+        if (!zstdData.empty())
+        {
+#ifdef NLMAP_WITH_ZSTD
+            size_t size = ZSTD_decompress(storage.data(), storage.size(), zstdData.data(), zstdData.size());
+            if (ZSTD_isError(size) || size != rawSize) { throw std::runtime_error("corrupt zstd blob"); }
+            return std::string_view(storage.data(), storage.size());
+#else
+            throw std::runtime_error("zstd compressed blobs require building with NLMAP_WITH_ZSTD");
+#endif
+        }
+
+        throw std::runtime_error("unsupported blob compression");
+    }
+
+private:
+
+    template <class F>
+    static void runThreads(size_t numThreads, F& work)
+    {
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < numThreads; i++) { threads.emplace_back([&work]() { work(); }); }
+        work();
+        for (auto& t : threads) { t.join(); }
+    }
+
+    // walks the blob headers and returns the raw bytes of every OSMData blob
+    static bool findDataBlobs(const MappedFile& file, std::vector<std::string_view>& blobs)
+    {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data());
+        size_t pos = 0;
+
+        while (pos < file.size())
+        {
+            if (file.size() - pos < 4) { return false; }
+
+            // each blob header is preceded by its length as a big endian int32
+            size_t headerSize = (size_t(data[pos]) << 24) | (size_t(data[pos + 1]) << 16) | (size_t(data[pos + 2]) << 8) | size_t(data[pos + 3]);
+            pos += 4;
+            if (headerSize > file.size() - pos) { return false; }
+
+            std::string_view type;
+            uint64_t dataSize = 0;
+            try
+            {
+                ProtoReader header(std::string_view(file.data() + pos, headerSize));
+                uint32_t field;
+                while (header.next(field))
+                {
+                    if      (field == 1) { type = header.bytes(); }
+                    else if (field == 3) { dataSize = header.varint(); }
+                    else                 { header.skip(); }
+                }
+            }
+            catch (const std::exception&) { return false; }
+
+            pos += headerSize;
+            if (dataSize > file.size() - pos) { return false; }
+
+            if (type == "OSMData") { blobs.push_back(std::string_view(file.data() + pos, size_t(dataSize))); }
+            pos += size_t(dataSize);
+        }
+
+        return true;
+    }
+
+    static void decodeBlob(std::string_view blob, BlockResult& result)
+    {
+        std::vector<char> storage;
+        std::string_view block = decompressBlob(blob, storage);
+
+        // the string table and the coordinate scaling can come after the groups, so read those first
+        std::vector<std::string_view> strings;
+        std::vector<std::string_view> groups;
+        int64_t granularity = 100, latOffset = 0, lonOffset = 0;
+
+        ProtoReader reader(block);
+        uint32_t field;
+        while (reader.next(field))
+        {
+            if (field == 1)
+            {
+                ProtoReader table(reader.bytes());
+                while (table.next(field))
+                {
+                    if (field == 1) { strings.push_back(table.bytes()); }
+                    else            { table.skip(); }
+                }
+            }
+            else if (field == 2)  { groups.push_back(reader.bytes()); }
+            else if (field == 17) { granularity = int64_t(reader.varint()); }
+            else if (field == 19) { latOffset = int64_t(reader.varint()); }
+            else if (field == 20) { lonOffset = int64_t(reader.varint()); }
+            else                  { reader.skip(); }
+        }
+
+        // the way tag field of each string in the table, or -1 if it is not a key we model
+        std::vector<int> tagOfString(strings.size(), -1);
+        for (size_t s = 0; s < strings.size(); s++)
+        {
+            for (int f = 0; f < WayTag::Count; f++)
+            {
+                if (strings[s] == WayTag::getName(WayTag::Field(f))) { tagOfString[s] = f; break; }
+            }
+        }
+
+        auto toDegrees = [granularity](int64_t offset, int64_t value) { return float(1e-9 * double(offset + granularity * value)); };
+
+        for (std::string_view group : groups)
+        {
+            ProtoReader g(group);
+            while (g.next(field))
+            {
+                if      (field == 1) { decodeNode(g.bytes(), result, latOffset, lonOffset, toDegrees); }
+                else if (field == 2) { decodeDenseNodes(g.bytes(), result, latOffset, lonOffset, toDegrees); }
+                else if (field == 3) { decodeWay(g.bytes(), result, strings, tagOfString); }
+                else                 { g.skip(); }
+            }
+        }
+    }
+
+    template <class ToDegrees>
+    static void decodeNode(std::string_view data, BlockResult& result, int64_t latOffset, int64_t lonOffset, ToDegrees& toDegrees)
+    {
+        int64_t id = 0, lat = 0, lon = 0;
+
+        ProtoReader reader(data);
+        uint32_t field;
+        while (reader.next(field))
+        {
+            if      (field == 1) { id = reader.svarint(); }
+            else if (field == 8) { lat = reader.svarint(); }
+            else if (field == 9) { lon = reader.svarint(); }
+            else                 { reader.skip(); }
+        }
+
+        result.nodes.push_back({ id, toDegrees(latOffset, lat), toDegrees(lonOffset, lon) });
+    }
+
+    template <class ToDegrees>
+    static void decodeDenseNodes(std::string_view data, BlockResult& result, int64_t latOffset, int64_t lonOffset, ToDegrees& toDegrees)
+    {
+        std::vector<int64_t> ids, lats, lons;
+
+        ProtoReader reader(data);
+        uint32_t field;
+        while (reader.next(field))
+        {
+            if      (field == 1) { reader.repeated<int64_t, true>(ids); }
+            else if (field == 8) { reader.repeated<int64_t, true>(lats); }
+            else if (field == 9) { reader.repeated<int64_t, true>(lons); }
+            else                 { reader.skip(); }
+        }
+
+        if (lats.size() != ids.size() || lons.size() != ids.size()) { throw std::runtime_error("bad dense nodes"); }
+
+        // ids and coordinates are delta coded
+        int64_t id = 0, lat = 0, lon = 0;
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            id += ids[i];
+            lat += lats[i];
+            lon += lons[i];
+            result.nodes.push_back({ id, toDegrees(latOffset, lat), toDegrees(lonOffset, lon) });
+        }
+    }
+
+    static void decodeWay(std::string_view data, BlockResult& result, const std::vector<std::string_view>& strings, const std::vector<int>& tagOfString)
+    {
+        int64_t id = 0;
+        std::vector<uint32_t> keys, values;
+        size_t firstRef = result.refs.size();
+
+        ProtoReader reader(data);
+        uint32_t field;
+        while (reader.next(field))
+        {
+            if      (field == 1) { id = int64_t(reader.varint()); }
+            else if (field == 2) { reader.repeated<uint32_t, false>(keys); }
+            else if (field == 3) { reader.repeated<uint32_t, false>(values); }
+            else if (field == 8) { reader.repeated<int64_t, true>(result.refs); }
+            else                 { reader.skip(); }
+        }
+
+        if (keys.size() != values.size()) { throw std::runtime_error("bad way tags"); }
+
+        Way way;
+        bool isHighway = false;
+        for (size_t k = 0; k < keys.size(); k++)
+        {
+            if (keys[k] >= strings.size() || values[k] >= strings.size()) { throw std::runtime_error("bad string index"); }
+
+            int f = tagOfString[keys[k]];
+            if (f < 0) { continue; }
+
+            way.tags[f] = result.tags.encode(WayTag::Field(f), strings[values[k]]);
+            isHighway |= (f == WayTag::Highway);
+        }
+
+        // only roads and paths are part of the map, drop everything else
+        if (!isHighway)
+        {
+            result.refs.resize(firstRef);
+            return;
+        }
+
+        // node references are delta coded
+        for (size_t r = firstRef + 1; r < result.refs.size(); r++) { result.refs[r] += result.refs[r - 1]; }
+
+        way.id = uint64_t(id);
+        result.ways.push_back(std::move(way));
+        result.refOffsets.push_back(result.refs.size());
+    }
+};
@@ -0,0 +1,415 @@
+#pragma once
+
+#include "MapData.hpp"
+#include "MappedFile.hpp"
+#include "NodeIndex.hpp"
+#include "DecompressingReader.hpp"
+#include "Timer.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// streaming reader for OpenStreetMap .osm xml files, plain or gzip / zstd compressed
+//
+// the file is read in fixed size blocks and scanned one element at a time, sax style, so the
+// document is never held in memory. the only state that grows with the input is the node
+// coordinate index (16 bytes per node) and the ways that are kept for the map itself
+// like the pbf importer, only ways with a highway tag are kept, with only the tags Way models
+class OSMXMLReader
+{
+    static constexpr size_t BlockSize = 4 << 20;
+
+    MapData&                    m_map;
+    NodeIndex                   m_nodes;
+    LoadProgress*               m_progress;
+
+    Way                         m_way;
+    std::vector<int64_t>        m_refs;
+    bool                        m_inWay = false;
+    bool                        m_isHighway = false;
+    std::string                 m_value;            // scratch space for decoding entities
+
+    std::vector<PreviewWay>     m_batch;
+    std::string                 m_error;
+
+public:
+
+    static bool isXML(const std::string& filename)
+    {
+        for (const char* extension : { ".osm", ".osm.gz", ".osm.zst" })
+        {
+            size_t length = std::strlen(extension);
+            if (filename.size() >= length && filename.compare(filename.size() - length, length, extension) == 0) { return true; }
+        }
+        return false;
+    }
+
+    static void load(MapData& map, const std::string& filename)
+    {
+        OSMXMLReader reader(map);
+        reader.read(filename);
+    }
+
+private:
+
+    explicit OSMXMLReader(MapData& map)
+        : m_map(map)
+        , m_progress(map.getProgress())
+    {
+    }
+
+    void read(const std::string& filename)
+    {
+        // compressed files are mapped and decompressed in blocks, plain files are simply read in blocks
+        MappedFile file(filename);
+        if (!file.isOpen())
+        {
+            std::cout << "Could not open map file: " << filename << "\n";
+            return;
+        }
+
+        DecompressingReader::Format format = DecompressingReader::detect(file.data(), file.size());
+        size_t fileSize = file.size();
+        if (format == DecompressingReader::None) { file.close(); }
+
+        std::ifstream fin;
+        DecompressingReader decompressor;
+        if (format == DecompressingReader::None)
+        {
+            fin.open(filename, std::ios::binary);
+        }
+        else if (!decompressor.start(file.data(), file.size(), format, BlockSize))
+        {
+            std::cout << "Could not read " << filename << ": " << decompressor.getError() << "\n";
+            return;
+        }
+
+        if (m_progress)
+        {
+            m_progress->stage = "Parsing OSM XML";
+            m_progress->totalBytes = fileSize;
+        }
+
+        std::cout << "Loading Way Data from OSM XML file...";
+        Timer timer;
+
+        // the buffer holds the unparsed tail of the previous block followed by the next block
+        std::vector<char> buffer;
+        std::vector<char> block;
+        size_t bytesRead = 0;
+
+        while (true)
+        {
+            if (m_map.isCancelled()) { std::cout << " cancelled\n"; return; }
+
+            if (format == DecompressingReader::None)
+            {
+                block.resize(BlockSize);
+                fin.read(block.data(), std::streamsize(block.size()));
+                block.resize(size_t(fin.gcount()));
+                if (block.empty()) { break; }
+                bytesRead += block.size();
+            }
+            else
+            {
+                if (!decompressor.next(block)) { break; }
+                bytesRead += block.size();
+            }
+
+            buffer.insert(buffer.end(), block.begin(), block.end());
+            size_t parsed = parse(buffer.data(), buffer.data() + buffer.size());
+            buffer.erase(buffer.begin(), buffer.begin() + std::ptrdiff_t(parsed));
+
+            if (!m_error.empty()) { break; }
+
+            if (m_progress)
+            {
+                m_progress->publish(m_batch, 0);
+                m_progress->bytesParsed = (format == DecompressingReader::None) ? bytesRead : decompressor.getCompressedBytesRead();
+            }
+        }
+
+        if (m_error.empty() && format != DecompressingReader::None) { m_error = decompressor.getError(); }
+        if (m_error.empty() && m_inWay) { m_error = "unexpected end of file inside a way"; }
+        if (!m_error.empty()) { std::cout << " OSM XML error: " << m_error << "\n"; return; }
+
+        double seconds = timer.getElapsedSec();
+        double megabytes = double(bytesRead) / (1024.0 * 1024.0);
+
+        m_map.getWayData().createVectorizedData();
+        size_t numWays = m_map.getWayData().getWays().size();
+        std::cout << " " << numWays << " ways, " << m_nodes.size() << " osm nodes (" << megabytes << " MB xml in " << seconds << "s, "
+                  << (megabytes / std::max(seconds, 1e-9)) << " MB/s, node index " << m_nodes.getMemoryBytes() / (1024.0 * 1024.0) << " MB)\n";
+
+        // the index is not needed any more once every way is resolved
+        m_nodes = NodeIndex();
+        m_map.buildNodeData();
+    }
+
+    // parses every complete piece of markup in [begin, end) and returns how many bytes were consumed
+    // an element cut off by the end of the block is left for the next call
+    size_t parse(const char* begin, const char* end)
+    {
+        const char* pos = begin;
+        while (m_error.empty())
+        {
+            const char* open = static_cast<const char*>(std::memchr(pos, '<', size_t(end - pos)));
+            if (!open) { return size_t(end - begin); }
+
+            // comments and cdata may contain '>' so they are skipped up to their own terminator
+            const char* close = nullptr;
+            if (startsWith(open, end, "<!--"))           { close = find(open, end, "-->"); }
+            else if (startsWith(open, end, "<![CDATA[")) { close = find(open, end, "]]>"); }
+            else                                         { close = findTagEnd(open + 1, end); }
+
+            if (!close) { return size_t(open - begin); }
+
+            element(std::string_view(open + 1, size_t(close - open - 1)));
+            pos = close + 1;
+        }
+
+        return size_t(pos - begin);
+    }
+
+    // handles the text between '<' and '>' of one element
+    void element(std::string_view text)
+    {
+        if (text.empty() || text[0] == '?' || text[0] == '!') { return; }
+
+        if (text[0] == '/')
+        {
+            if (name(text.substr(1)) == "way") { endWay(); }
+            return;
+        }
+
+        bool selfClosing = text.back() == '/';
+        if (selfClosing) { text.remove_suffix(1); }
+
+        std::string_view tag = name(text);
+        std::string_view attributes = text.substr(tag.size());
+
+        if (tag == "node")
+        {
+            int64_t id = 0;
+            float lat = 0, lon = 0;
+            bool hasID = false, hasLat = false, hasLon = false;
+            forEachAttribute(attributes, [&](std::string_view key, std::string_view value)
+            {
+                if      (key == "id")  { hasID = parseNumber(value, id); }
+                else if (key == "lat") { hasLat = parseNumber(value, lat); }
+                else if (key == "lon") { hasLon = parseNumber(value, lon); }
+            });
+
+            if (hasID && hasLat && hasLon) { m_nodes.add(id, lat, lon); }
+        }
+        else if (tag == "way")
+        {
+            m_way = Way();
+            m_refs.clear();
+            m_inWay = true;
+            m_isHighway = false;
+            forEachAttribute(attributes, [&](std::string_view key, std::string_view value)
+            {
+                if (key == "id") { parseNumber(value, m_way.id); }
+            });
+
+            if (selfClosing) { endWay(); }
+        }
+        else if (tag == "nd" && m_inWay)
+        {
+            forEachAttribute(attributes, [&](std::string_view key, std::string_view value)
+            {
+                int64_t ref = 0;
+                if (key == "ref" && parseNumber(value, ref)) { m_refs.push_back(ref); }
+            });
+        }
+        else if (tag == "tag" && m_inWay)
+        {
+            std::string_view k, v;
+            forEachAttribute(attributes, [&](std::string_view key, std::string_view value)
+            {
+                if      (key == "k") { k = value; }
+                else if (key == "v") { v = value; }
+            });
+
+            for (size_t f = 0; f < WayTag::Count; f++)
+            {
+                if (k != WayTag::getName(WayTag::Field(f))) { continue; }
+
+                m_way.tags[f] = m_map.getWayData().getTags().encode(WayTag::Field(f), decodeEntities(v));
+                m_isHighway |= (f == WayTag::Highway);
+                break;
+            }
+        }
+    }
+
+    // resolves the node references of the finished way and adds it to the map if it is a highway
+    void endWay()
+    {
+        if (!m_inWay) { return; }
+        m_inWay = false;
+
+        if (!m_isHighway) { return; }
+
+        // osm files list all nodes before the ways, so this only sorts for unusually ordered files
+        m_nodes.sort();
+
+        // references to nodes missing from the file (clipped at the edge of an extract) are dropped
+        for (int64_t ref : m_refs)
+        {
+            const NodeIndex::Entry* node = m_nodes.find(ref);
+            if (!node) { continue; }
+
+            // the same rotation as the csv loader to match the sfml drawing direction
+            m_way.nodes.push_back(Node(node->lon, -node->lat));
+        }
+
+        m_way.count = int(m_way.nodes.size());
+        if (m_way.nodes.empty()) { return; }
+
+        if (m_progress)
+        {
+            PreviewWay& preview = m_batch.emplace_back();
+            preview.highway = m_map.getWayData().getTags().decode(WayTag::Highway, m_way.getTag(WayTag::Highway));
+            for (const Node& n : m_way.nodes) { preview.points.push_back(n.p); }
+        }
+
+        m_map.getWayData().addWay(std::move(m_way));
+    }
+
+    // the element name at the start of text
+    static std::string_view name(std::string_view text)
+    {
+        size_t length = 0;
+        while (length < text.size() && !isSpace(text[length]) && text[length] != '/') { length++; }
+        return text.substr(0, length);
+    }
+
+    // calls f(key, value) for every key="value" or key='value' attribute, values are not decoded
+    template <class F>
+    void forEachAttribute(std::string_view text, F f)
+    {
+        size_t i = 0;
+        while (true)
+        {
+            while (i < text.size() && isSpace(text[i])) { i++; }
+            if (i >= text.size()) { return; }
+
+            size_t eq = text.find('=', i);
+            if (eq == std::string_view::npos) { m_error = "bad attribute"; return; }
+
+            std::string_view key = text.substr(i, eq - i);
+            while (!key.empty() && isSpace(key.back())) { key.remove_suffix(1); }
+
+            size_t quote = eq + 1;
+            while (quote < text.size() && isSpace(text[quote])) { quote++; }
+            if (quote >= text.size() || (text[quote] != '"' && text[quote] != '\'')) { m_error = "bad attribute"; return; }
+
+            size_t close = text.find(text[quote], quote + 1);
+            if (close == std::string_view::npos) { m_error = "bad attribute"; return; }
+
+            f(key, text.substr(quote + 1, close - quote - 1));
+            i = close + 1;
+        }
+    }
+
+    // replaces the predefined xml entities and numeric character references in an attribute value
+    std::string_view decodeEntities(std::string_view value)
+    {
+        if (value.find('&') == std::string_view::npos) { return value; }
+
+        m_value.clear();
+        for (size_t i = 0; i < value.size(); i++)
+        {
+            size_t semicolon = (value[i] == '&') ? value.find(';', i) : std::string_view::npos;
+            if (semicolon == std::string_view::npos) { m_value += value[i]; continue; }
+
+            std::string_view entity = value.substr(i + 1, semicolon - i - 1);
+            if      (entity == "amp")  { m_value += '&'; }
+            else if (entity == "lt")   { m_value += '<'; }
+            else if (entity == "gt")   { m_value += '>'; }
+            else if (entity == "quot") { m_value += '"'; }
+            else if (entity == "apos") { m_value += '\''; }
+            else if (entity.size() > 1 && entity[0] == '#')
+            {
+                uint32_t code = 0;
+                bool hex = entity[1] == 'x' || entity[1] == 'X';
+                std::string_view digits = entity.substr(hex ? 2 : 1);
+                if (std::from_chars(digits.data(), digits.data() + digits.size(), code, hex ? 16 : 10).ec != std::errc()) { code = '?'; }
+                appendUTF8(code);
+            }
+            else
+            {
+                m_value.append(value.substr(i, semicolon - i + 1));
+            }
+
+            i = semicolon;
+        }
+
+        return m_value;
+    }
+
+    void appendUTF8(uint32_t code)
+    {
+        if (code < 0x80)
+        {
+            m_value += char(code);
+        }
+        else if (code < 0x800)
+        {
+            m_value += char(0xc0 | (code >> 6));
+            m_value += char(0x80 | (code & 0x3f));
+        }
+        else if (code < 0x10000)
+        {
+            m_value += char(0xe0 | (code >> 12));
+            m_value += char(0x80 | ((code >> 6) & 0x3f));
+            m_value += char(0x80 | (code & 0x3f));
+        }
+        else
+        {
+            m_value += char(0xf0 | ((code >> 18) & 0x07));
+            m_value += char(0x80 | ((code >> 12) & 0x3f));
+            m_value += char(0x80 | ((code >> 6) & 0x3f));
+            m_value += char(0x80 | (code & 0x3f));
+        }
+    }
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static bool startsWith(const char* pos, const char* end, std::string_view prefix)
+    {
+        return size_t(end - pos) >= prefix.size() && std::memcmp(pos, prefix.data(), prefix.size()) == 0;
+    }
+
+    // the position of the last character of the first occurrence of terminator, or nullptr
+    static const char* find(const char* pos, const char* end, std::string_view terminator)
+    {
+        const char* found = std::search(pos, end, terminator.begin(), terminator.end());
+        return (found == end) ? nullptr : found + terminator.size() - 1;
+    }
+
+    // the '>' that ends the tag starting at pos, attribute values may contain '>' so quotes are skipped
+    static const char* findTagEnd(const char* pos, const char* end)
+    {
+        char quote = 0;
+        for (; pos < end; pos++)
+        {
+            if (quote)                          { if (*pos == quote) { quote = 0; } }
+            else if (*pos == '"' || *pos == '\'') { quote = *pos; }
+            else if (*pos == '>')               { return pos; }
+        }
+        return nullptr;
+    }
+};
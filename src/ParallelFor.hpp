@@ -0,0 +1,23 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// splits [0, count) into one contiguous range per thread and calls f(thread, begin, end) for each
+// the calling thread runs the first range itself, small inputs are not split at all
+template <class F>
+void parallelFor(size_t numThreads, size_t count, F&& f, size_t minPerThread = 1 << 14)
+{
+    numThreads = std::max<size_t>(1, std::min(numThreads, count / std::max<size_t>(1, minPerThread)));
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < numThreads; t++)
+    {
+        threads.emplace_back([&f, t, numThreads, count]() { f(t, count * t / numThreads, count * (t + 1) / numThreads); });
+    }
+
+    f(size_t(0), size_t(0), count / numThreads);
+    for (auto& thread : threads) { thread.join(); }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+// counts the last level cache misses of the calling thread between start() and stop()
+// only linux exposes the hardware counters to user code, elsewhere and in containers that
+// forbid perf events the counter is simply not available
+class PerfCounter
+{
+    int m_fd = -1;
+
+public:
+
+    PerfCounter()
+    {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~PerfCounter()
+    {
+#ifdef __linux__
+        if (m_fd >= 0) { close(m_fd); }
+#endif
+    }
+
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+
+    bool isAvailable() const
+    {
+        return m_fd >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if (m_fd < 0) { return; }
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    // the number of misses since start(), 0 if the counter is not available
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (m_fd < 0) { return 0; }
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(m_fd, &count, sizeof(count)) != sizeof(count)) { count = 0; }
+#endif
+        return count;
+    }
+};
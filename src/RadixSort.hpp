@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ParallelFor.hpp"
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// stable parallel LSD radix sort of items by a 64 bit key, 8 bits per pass
+//
+// every pass histograms each thread's range, turns the histograms into per thread write offsets,
+// and scatters each range in order, so equal keys keep their original order across threads
+// passes where every key has the same digit are skipped, which for packed coordinates of a
+// single region removes most of the passes over the high exponent and sign bits
+template <class T, class KeyFn>
+void radixSort(std::vector<T>& items, KeyFn key, size_t numThreads)
+{
+    const size_t n = items.size();
+    if (n < 2) { return; }
+
+    // the digits that are the same for every key never change the order
+    std::array<bool, 8> skip;
+    skip.fill(true);
+    uint64_t first = key(items[0]);
+    for (const T& item : items)
+    {
+        uint64_t diff = key(item) ^ first;
+        for (size_t d = 0; d < 8; d++) { skip[d] = skip[d] && ((diff >> (8 * d)) & 0xff) == 0; }
+    }
+
+    std::vector<T> buffer(n);
+    numThreads = std::max<size_t>(1, std::min(numThreads, n / (1 << 14)));
+    std::vector<std::array<size_t, 256>> offsets(numThreads);
+
+    for (size_t d = 0; d < 8; d++)
+    {
+        if (skip[d]) { continue; }
+        const size_t shift = 8 * d;
+
+        parallelFor(numThreads, n, [&](size_t t, size_t begin, size_t end)
+        {
+            offsets[t].fill(0);
+            for (size_t i = begin; i < end; i++) { offsets[t][(key(items[i]) >> shift) & 0xff]++; }
+        }, 1);
+
+        // digit major, thread minor, which is what keeps the sort stable
+        size_t sum = 0;
+        for (size_t b = 0; b < 256; b++)
+        {
+            for (size_t t = 0; t < numThreads; t++)
+            {
+                size_t count = offsets[t][b];
+                offsets[t][b] = sum;
+                sum += count;
+            }
+        }
+
+        parallelFor(numThreads, n, [&](size_t t, size_t begin, size_t end)
+        {
+            std::array<size_t, 256>& offset = offsets[t];
+            for (size_t i = begin; i < end; i++) { buffer[offset[(key(items[i]) >> shift) & 0xff]++] = std::move(items[i]); }
+        }, 1);
+
+        items.swap(buffer);
+    }
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "Graph.hpp"
+
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+// the road network reduced to its junctions
+//
+// most nodes are shape points in the middle of a way with exactly two neighbors. every chain of
+// such nodes between two junctions (nodes whose degree is not 2) becomes a single edge, whose
+// length and travel time are summed over the chain. the shape points of each edge are kept in
+// order, so a path found in this graph can be unpacked back into nodes of the full graph.
+// it is undirected and ignores the access rules of the travel modes, so no search uses it, only
+// Benchmark::reportRoutingGraph() builds it to measure how much smaller than the full graph it is
+class RoutingGraph
+{
+    std::vector<uint32_t>   m_nodeOfJunction;       // junction -> node of the full graph
+    std::vector<uint32_t>   m_junctionOfNode;       // node of the full graph -> junction, or None
+    std::vector<uint32_t>   m_offsets{ 0 };         // numJunctions + 1, edges of junction j start at m_offsets[j]
+    std::vector<uint32_t>   m_targets;              // target junction of each edge
+    std::vector<float>      m_lengths;              // summed length of the chain of each edge, in meters
+    std::vector<float>      m_travelTimes;          // summed travel time of the chain of each edge, in seconds
+    std::vector<uint32_t>   m_pathOffsets{ 0 };     // numEdges + 1, the shape points of edge e start at m_pathOffsets[e]
+    std::vector<uint32_t>   m_pathNodes;            // shape points of every edge, in order from source to target
+
+public:
+
+    static constexpr uint32_t None = UINT32_MAX;
+
+    RoutingGraph() = default;
+
+    void build(const Graph& graph)
+    {
+        const size_t numNodes = graph.numNodes();
+
+        // a node with two edges to the same neighbor is where a way doubles back, so it stays
+        m_junctionOfNode.assign(numNodes, None);
+        m_nodeOfJunction.clear();
+        std::vector<bool> visited(numNodes, false);
+        for (size_t n = 0; n < numNodes; n++)
+        {
+            if (!isShapePoint(graph, n)) { addJunction(n); }
+        }
+
+        // shape points not reached from any junction form closed rings, one node of each ring becomes a junction
+        for (uint32_t j = 0; j < m_nodeOfJunction.size(); j++)
+        {
+            forEachChain(graph, m_nodeOfJunction[j], [&](uint32_t, double, double, std::span<const uint32_t> path)
+            {
+                for (uint32_t p : path) { visited[p] = true; }
+            });
+        }
+        for (size_t n = 0; n < numNodes; n++)
+        {
+            if (m_junctionOfNode[n] != None || visited[n]) { continue; }
+
+            addJunction(n);
+            forEachChain(graph, uint32_t(n), [&](uint32_t, double, double, std::span<const uint32_t> path)
+            {
+                for (uint32_t p : path) { visited[p] = true; }
+            });
+        }
+
+        // every chain is walked once from each end, which gives both directions of its edge
+        m_offsets.assign(1, 0);
+        m_targets.clear();
+        m_lengths.clear();
+        m_travelTimes.clear();
+        m_pathOffsets.assign(1, 0);
+        m_pathNodes.clear();
+        for (uint32_t j = 0; j < m_nodeOfJunction.size(); j++)
+        {
+            forEachChain(graph, m_nodeOfJunction[j], [&](uint32_t end, double length, double travelTime, std::span<const uint32_t> path)
+            {
+                // a ring that comes back to where it started can never be part of a shortest path
+                if (end == m_nodeOfJunction[j]) { return; }
+
+                m_targets.push_back(m_junctionOfNode[end]);
+                m_lengths.push_back(float(length));
+                m_travelTimes.push_back(float(travelTime));
+                m_pathNodes.insert(m_pathNodes.end(), path.begin(), path.end());
+                m_pathOffsets.push_back(uint32_t(m_pathNodes.size()));
+            });
+            m_offsets.push_back(uint32_t(m_targets.size()));
+        }
+    }
+
+    size_t numJunctions() const
+    {
+        return m_nodeOfJunction.size();
+    }
+
+    size_t numEdges() const
+    {
+        return m_targets.size();
+    }
+
+    uint32_t beginEdge(size_t junction) const
+    {
+        return m_offsets[junction];
+    }
+
+    uint32_t endEdge(size_t junction) const
+    {
+        return m_offsets[junction + 1];
+    }
+
+    uint32_t target(uint32_t edge) const
+    {
+        return m_targets[edge];
+    }
+
+    // length in meters
+    float length(uint32_t edge) const
+    {
+        return m_lengths[edge];
+    }
+
+    // travel time in seconds, 0 if the graph it was built from had no travel times
+    float travelTime(uint32_t edge) const
+    {
+        return m_travelTimes[edge];
+    }
+
+    // the node of the full graph a junction stands for
+    uint32_t nodeOf(size_t junction) const
+    {
+        return m_nodeOfJunction[junction];
+    }
+
+    // the junction of a node of the full graph, or None if it is a shape point
+    uint32_t junctionOf(size_t node) const
+    {
+        return m_junctionOfNode[node];
+    }
+
+    // the shape points an edge passes through, without its source and target junction
+    std::span<const uint32_t> path(uint32_t edge) const
+    {
+        return std::span<const uint32_t>(m_pathNodes.data() + m_pathOffsets[edge], m_pathOffsets[edge + 1] - m_pathOffsets[edge]);
+    }
+
+    // appends the nodes of the full graph an edge covers, from its source junction up to but not
+    // including its target junction, so the edges of a path can be unpacked one after the other
+    void unpackEdge(uint32_t sourceJunction, uint32_t edge, std::vector<uint32_t>& nodes) const
+    {
+        nodes.push_back(m_nodeOfJunction[sourceJunction]);
+        std::span<const uint32_t> shape = path(edge);
+        nodes.insert(nodes.end(), shape.begin(), shape.end());
+    }
+
+    size_t getMemoryBytes() const
+    {
+        return (m_nodeOfJunction.capacity() + m_junctionOfNode.capacity() + m_offsets.capacity() + m_targets.capacity()
+              + m_pathOffsets.capacity() + m_pathNodes.capacity()) * sizeof(uint32_t) + (m_lengths.capacity() + m_travelTimes.capacity()) * sizeof(float);
+    }
+
+private:
+
+    static bool isShapePoint(const Graph& graph, size_t node)
+    {
+        return graph.degree(node) == 2 && graph.target(graph.beginEdge(node)) != graph.target(graph.beginEdge(node) + 1);
+    }
+
+    void addJunction(size_t node)
+    {
+        m_junctionOfNode[node] = uint32_t(m_nodeOfJunction.size());
+        m_nodeOfJunction.push_back(uint32_t(node));
+    }
+
+    // follows every edge of a junction through shape points until the next junction, and calls
+    // f(end node, summed length, summed travel time, shape points) once per edge
+    template <class F>
+    void forEachChain(const Graph& graph, uint32_t start, F f) const
+    {
+        std::vector<uint32_t> path;
+        for (uint32_t e = graph.beginEdge(start); e < graph.endEdge(start); e++)
+        {
+            path.clear();
+            uint32_t prev = start;
+            uint32_t node = graph.target(e);
+            const bool timed = graph.hasTravelTimes();
+            double length = graph.length(e);
+            double travelTime = timed ? graph.travelTime(e) : 0.0;
+            while (m_junctionOfNode[node] == None)
+            {
+                path.push_back(node);
+                uint32_t first = graph.beginEdge(node);
+                uint32_t next = graph.target(first) == prev ? first + 1 : first;
+                prev = node;
+                node = graph.target(next);
+                length += graph.length(next);
+                travelTime += timed ? graph.travelTime(next) : 0.0;
+            }
+            f(node, length, travelTime, std::span<const uint32_t>(path));
+        }
+    }
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "TravelMode.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// the speeds that turn the length of an edge into its travel time, derived from the tags of its way
+//
+// a way's speed is its maxspeed tag when that can be read, otherwise the speed of its highway type,
+// scaled by a factor for its number of lanes since narrow roads rarely run at their limit
+// bikes and pedestrians move at their own steady speed on every way they may use
+// every value can be changed before the map is loaded, speeds are in km/h
+class SpeedTable
+{
+    std::unordered_map<std::string, float> m_highwaySpeeds;
+    float               m_defaultSpeed = 30.0f;     // highway types not in the table
+    std::vector<float>  m_laneFactors;              // by number of lanes, index 0 is for ways without a lanes tag
+    float               m_bikeSpeed = 18.0f;
+    float               m_footSpeed = 5.0f;
+
+public:
+
+    SpeedTable()
+    {
+        m_highwaySpeeds =
+        {
+            { "motorway", 110 },    { "motorway_link", 60 },
+            { "trunk", 90 },        { "trunk_link", 50 },
+            { "primary", 70 },      { "primary_link", 45 },
+            { "secondary", 60 },    { "secondary_link", 40 },
+            { "tertiary", 50 },     { "tertiary_link", 35 },
+            { "unclassified", 40 }, { "residential", 30 },
+            { "living_street", 10 },{ "service", 20 },
+            { "track", 15 },        { "road", 30 },
+            { "busway", 40 },       { "pedestrian", 5 },
+            { "footway", 5 },       { "path", 5 },
+            { "steps", 2 },         { "cycleway", 18 },
+        };
+        m_laneFactors = { 0.9f, 0.85f, 0.9f, 0.95f, 1.0f };
+    }
+
+    void setHighwaySpeed(const std::string& highway, float kmh)
+    {
+        m_highwaySpeeds[highway] = kmh;
+    }
+
+    void setDefaultSpeed(float kmh)
+    {
+        m_defaultSpeed = kmh;
+    }
+
+    // lanes beyond the last factor use the last factor
+    void setLaneFactor(size_t lanes, float factor)
+    {
+        if (lanes >= m_laneFactors.size()) { m_laneFactors.resize(lanes + 1, m_laneFactors.back()); }
+        m_laneFactors[lanes] = factor;
+    }
+
+    void setBikeSpeed(float kmh)
+    {
+        m_bikeSpeed = kmh;
+    }
+
+    void setFootSpeed(float kmh)
+    {
+        m_footSpeed = kmh;
+    }
+
+    float getBikeSpeed() const
+    {
+        return m_bikeSpeed;
+    }
+
+    float getFootSpeed() const
+    {
+        return m_footSpeed;
+    }
+
+    const std::unordered_map<std::string, float>& getHighwaySpeeds() const
+    {
+        return m_highwaySpeeds;
+    }
+
+    float getDefaultSpeed() const
+    {
+        return m_defaultSpeed;
+    }
+
+    float getHighwaySpeed(std::string_view highway) const
+    {
+        auto it = m_highwaySpeeds.find(std::string(highway));
+        return it == m_highwaySpeeds.end() ? m_defaultSpeed : it->second;
+    }
+
+    float getLaneFactor(size_t lanes) const
+    {
+        return m_laneFactors[std::min(lanes, m_laneFactors.size() - 1)];
+    }
+
+    // the speed in km/h of a way with the given tags
+    float getSpeed(std::string_view highway, std::string_view maxspeed, std::string_view lanes) const
+    {
+        float limit = parseMaxSpeed(maxspeed);
+        return (limit > 0 ? limit : getHighwaySpeed(highway)) * getLaneFactor(parseLanes(lanes));
+    }
+
+    // the speed in km/h of a way for a travel mode
+    float getSpeed(TravelMode mode, std::string_view highway, std::string_view maxspeed, std::string_view lanes) const
+    {
+        switch (mode)
+        {
+            case TravelMode::Car:  return getSpeed(highway, maxspeed, lanes);
+            case TravelMode::Bike: return m_bikeSpeed;
+            case TravelMode::Foot: return m_footSpeed;
+        }
+        return m_defaultSpeed;
+    }
+
+    // reads "50", "50 km/h", "30 mph" or "30mph", returns 0 for anything else, such as "none" or "signals"
+    static float parseMaxSpeed(std::string_view value)
+    {
+        float speed = 0;
+        auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), speed);
+        if (error != std::errc() || speed <= 0) { return 0; }
+
+        std::string_view unit = value.substr(size_t(end - value.data()));
+        while (!unit.empty() && unit.front() == ' ') { unit.remove_prefix(1); }
+        if (unit == "mph")                      { return speed * 1.609344f; }
+        if (unit.empty() || unit == "km/h" || unit == "kmh") { return speed; }
+        return 0;
+    }
+
+    // the number of lanes, 0 if the tag is missing or not a number, a value such as "2;3" counts its first part
+    static size_t parseLanes(std::string_view value)
+    {
+        unsigned lanes = 0;
+        auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), lanes);
+        return error == std::errc() ? lanes : 0;
+    }
+};
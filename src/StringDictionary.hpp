@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// maps each distinct string to a small integer code, in order of first appearance
+// the empty string is always code 0, so a default constructed code means "no value"
+class StringDictionary
+{
+    // a deque never moves its elements, so the lookup keys can view the stored strings
+    std::deque<std::string>                         m_strings;
+    std::unordered_map<std::string_view, uint32_t>  m_codes;
+
+public:
+
+    StringDictionary()
+    {
+        encode("");
+    }
+
+    // copying would leave the copied keys viewing the original strings, moving keeps them valid
+    StringDictionary(const StringDictionary&) = delete;
+    StringDictionary& operator=(const StringDictionary&) = delete;
+    StringDictionary(StringDictionary&&) = default;
+    StringDictionary& operator=(StringDictionary&&) = default;
+
+    // returns the code of the given string, adding it to the dictionary if it is new
+    uint32_t encode(std::string_view value)
+    {
+        auto it = m_codes.find(value);
+        if (it != m_codes.end()) { return it->second; }
+
+        uint32_t code = uint32_t(m_strings.size());
+        m_strings.emplace_back(value);
+        m_codes.emplace(m_strings.back(), code);
+        return code;
+    }
+
+    // returns the code of the given string, or -1 if it is not in the dictionary
+    int64_t find(std::string_view value) const
+    {
+        auto it = m_codes.find(value);
+        return it == m_codes.end() ? -1 : int64_t(it->second);
+    }
+
+    const std::string& decode(uint32_t code) const
+    {
+        return m_strings[code];
+    }
+
+    size_t size() const
+    {
+        return m_strings.size();
+    }
+
+    // approximate heap memory used by the dictionary
+    size_t getMemoryBytes() const
+    {
+        size_t bytes = 0;
+        for (const std::string& s : m_strings)
+        {
+            bytes += sizeof(std::string) + (s.size() > std::string().capacity() ? s.capacity() + 1 : 0);
+        }
+        return bytes + m_codes.size() * (sizeof(std::string_view) + sizeof(uint32_t) + 2 * sizeof(void*));
+    }
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <chrono>
+
+// simple wall clock timer used to report loading and search times
+class Timer
+{
+    std::chrono::steady_clock::time_point m_start;
+
+public:
+
+    Timer()
+    {
+        start();
+    }
+
+    void start()
+    {
+        m_start = std::chrono::steady_clock::now();
+    }
+
+    double getElapsedSec() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+    double getElapsedMillis() const
+    {
+        return getElapsedSec() * 1000.0;
+    }
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// the ways of getting around a map, each with its own legal edges and speeds
+enum class TravelMode : uint8_t { Car = 0, Bike, Foot };
+
+static constexpr size_t NumTravelModes = 3;
+
+inline const char* getTravelModeName(TravelMode mode)
+{
+    switch (mode)
+    {
+        case TravelMode::Car:  return "car";
+        case TravelMode::Bike: return "bike";
+        case TravelMode::Foot: return "foot";
+    }
+    return "";
+}
+
+// which ways a mode may use and in which directions, from the osm tags of the way
+//
+// a mode specific tag (motorcar, motor_vehicle, bicycle, foot) decides first, then whether the
+// highway type is one the mode uses at all, then the general access tag. one way streets, and
+// roundabouts and motorways which are one way without saying so, bind cars and bikes but not feet
+class AccessRules
+{
+public:
+
+    // bits of the directions a way can be traveled in, relative to the order of its vertices
+    enum Direction : uint8_t { None = 0, Forward = 1, Backward = 2, Both = 3 };
+
+    struct WayTags
+    {
+        std::string_view highway, oneway, junction, access, motorVehicle, motorcar, bicycle, foot;
+    };
+
+    static uint8_t getDirections(TravelMode mode, const WayTags& tags)
+    {
+        // the most specific tag that says anything wins
+        std::string_view specific;
+        switch (mode)
+        {
+            case TravelMode::Car:  specific = !tags.motorcar.empty() ? tags.motorcar : tags.motorVehicle; break;
+            case TravelMode::Bike: specific = tags.bicycle; break;
+            case TravelMode::Foot: specific = tags.foot; break;
+        }
+
+        if (isDenied(specific)) { return None; }
+        if (!isGranted(specific))
+        {
+            if (!usesHighway(mode, tags.highway) || isDenied(tags.access)) { return None; }
+        }
+
+        if (mode == TravelMode::Foot) { return Both; }
+
+        const std::string_view oneway = tags.oneway;
+        if (oneway == "yes" || oneway == "1" || oneway == "true") { return Forward; }
+        if (oneway == "-1" || oneway == "reverse")               { return Backward; }
+        if (oneway == "no" || oneway == "0" || oneway == "false") { return Both; }
+        if (tags.junction == "roundabout" || tags.highway == "motorway" || tags.highway == "motorway_link") { return Forward; }
+        return Both;
+    }
+
+    // the highway types a mode uses when no tag says otherwise
+    static bool usesHighway(TravelMode mode, std::string_view highway)
+    {
+        static constexpr std::string_view roads[] =
+        {
+            "motorway", "motorway_link", "trunk", "trunk_link", "primary", "primary_link", "secondary", "secondary_link",
+            "tertiary", "tertiary_link", "unclassified", "residential", "living_street", "service", "road"
+        };
+        static constexpr std::string_view paths[] = { "track", "path", "cycleway", "footway", "pedestrian", "steps", "bridleway" };
+
+        bool isRoad = false, isPath = false;
+        for (std::string_view r : roads) { isRoad = isRoad || highway == r; }
+        for (std::string_view p : paths) { isPath = isPath || highway == p; }
+
+        switch (mode)
+        {
+            case TravelMode::Car:  return isRoad;
+            case TravelMode::Bike: return (isRoad || isPath) && highway.substr(0, 8) != "motorway" && highway != "footway"
+                                       && highway != "pedestrian" && highway != "steps" && highway != "bridleway";
+            case TravelMode::Foot: return (isRoad || isPath) && highway.substr(0, 8) != "motorway";
+        }
+        return false;
+    }
+
+    static bool isDenied(std::string_view value)
+    {
+        return value == "no" || value == "private";
+    }
+
+    static bool isGranted(std::string_view value)
+    {
+        return value == "yes" || value == "designated" || value == "permissive" || value == "destination";
+    }
+};
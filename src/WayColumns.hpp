@@ -0,0 +1,241 @@
+#pragma once
+
+#include "MapData.hpp"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+    #include <emmintrin.h>
+    #define NLMAP_SSE2 1
+#endif
+
+// a set of ways, stored as one bit per way index
+class WayBitset
+{
+    std::vector<uint64_t>   m_words;
+    size_t                  m_size = 0;
+
+public:
+
+    WayBitset() = default;
+
+    explicit WayBitset(size_t size, bool value = false)
+        : m_words((size + 63) / 64, value ? ~uint64_t(0) : 0)
+        , m_size(size)
+    {
+        clearPadding();
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool test(size_t i) const
+    {
+        return (m_words[i / 64] >> (i % 64)) & 1;
+    }
+
+    uint64_t* words()
+    {
+        return m_words.data();
+    }
+
+    size_t count() const
+    {
+        size_t c = 0;
+        for (uint64_t w : m_words) { c += size_t(std::popcount(w)); }
+        return c;
+    }
+
+    // the indexes of every way in the set, in increasing order
+    std::vector<uint32_t> toIndexes() const
+    {
+        std::vector<uint32_t> indexes;
+        indexes.reserve(count());
+        for (size_t w = 0; w < m_words.size(); w++)
+        {
+            for (uint64_t bits = m_words[w]; bits; bits &= bits - 1)
+            {
+                indexes.push_back(uint32_t(w * 64 + size_t(std::countr_zero(bits))));
+            }
+        }
+        return indexes;
+    }
+
+    WayBitset& operator&=(const WayBitset& other)
+    {
+        for (size_t w = 0; w < m_words.size(); w++) { m_words[w] &= other.m_words[w]; }
+        return *this;
+    }
+
+    WayBitset& operator|=(const WayBitset& other)
+    {
+        for (size_t w = 0; w < m_words.size(); w++) { m_words[w] |= other.m_words[w]; }
+        return *this;
+    }
+
+    WayBitset operator~() const
+    {
+        WayBitset result(*this);
+        for (uint64_t& w : result.m_words) { w = ~w; }
+        result.clearPadding();
+        return result;
+    }
+
+    friend WayBitset operator&(WayBitset a, const WayBitset& b) { a &= b; return a; }
+    friend WayBitset operator|(WayBitset a, const WayBitset& b) { a |= b; return a; }
+
+private:
+
+    // bits past the last way must stay zero so count() and ~ stay correct
+    void clearPadding()
+    {
+        if (m_size % 64 != 0) { m_words.back() &= (uint64_t(1) << (m_size % 64)) - 1; }
+    }
+};
+
+// column oriented copy of the way tags: one contiguous array of codes per tag field
+// each column uses the narrowest integer type that holds its largest code, so that
+// a filter over a low cardinality column like highway or lit compares 16 ways per
+// SSE2 instruction, instead of touching every field of every Way record
+class WayColumns
+{
+    struct Column
+    {
+        size_t              width = 1;  // bytes per code: 1, 2 or 4
+        std::vector<char>   codes;
+    };
+
+    Column  m_columns[WayTag::Count];
+    size_t  m_numWays = 0;
+
+public:
+
+    void build(const std::vector<Way>& ways)
+    {
+        m_numWays = ways.size();
+
+        for (size_t f = 0; f < WayTag::Count; f++)
+        {
+            uint32_t maxCode = 0;
+            for (const Way& way : ways) { maxCode = std::max(maxCode, way.tags[f]); }
+
+            Column& column = m_columns[f];
+            column.width = maxCode <= UINT8_MAX ? 1 : (maxCode <= UINT16_MAX ? 2 : 4);
+            column.codes.assign(m_numWays * column.width, 0);
+
+            if      (column.width == 1) { fill<uint8_t>(column, ways, f); }
+            else if (column.width == 2) { fill<uint16_t>(column, ways, f); }
+            else                        { fill<uint32_t>(column, ways, f); }
+        }
+    }
+
+    size_t size() const
+    {
+        return m_numWays;
+    }
+
+    size_t getMemoryBytes() const
+    {
+        size_t bytes = 0;
+        for (const Column& column : m_columns) { bytes += column.codes.size(); }
+        return bytes;
+    }
+
+    // all ways whose field has the given code
+    WayBitset equals(WayTag::Field field, uint32_t code) const
+    {
+        WayBitset result(m_numWays);
+        const Column& column = m_columns[field];
+
+        if      (column.width == 1) { if (code <= UINT8_MAX)  { matchEquals(reinterpret_cast<const uint8_t*>(column.codes.data()), uint8_t(code), result); } }
+        else if (column.width == 2) { if (code <= UINT16_MAX) { matchEquals(reinterpret_cast<const uint16_t*>(column.codes.data()), uint16_t(code), result); } }
+        else                        { matchEquals(reinterpret_cast<const uint32_t*>(column.codes.data()), code, result); }
+
+        return result;
+    }
+
+    // all ways whose field has the given text, an unknown value matches no ways
+    WayBitset equals(WayTag::Field field, std::string_view value, const WayTagDictionary& tags) const
+    {
+        int64_t code = tags.getField(field).find(value);
+        return code < 0 ? WayBitset(m_numWays) : equals(field, uint32_t(code));
+    }
+
+    // all ways whose field has any of the given codes
+    WayBitset in(WayTag::Field field, const std::vector<uint32_t>& codes) const
+    {
+        WayBitset result(m_numWays);
+        for (uint32_t code : codes) { result |= equals(field, code); }
+        return result;
+    }
+
+private:
+
+    template <class T>
+    void fill(Column& column, const std::vector<Way>& ways, size_t field)
+    {
+        T* codes = reinterpret_cast<T*>(column.codes.data());
+        for (size_t i = 0; i < ways.size(); i++) { codes[i] = T(ways[i].tags[field]); }
+    }
+
+#ifdef NLMAP_SSE2
+    // 16 bit mask of which of the next 16 codes equal value, one SSE2 compare per 16, 8 or 4 codes
+    static uint32_t matchMask16(const uint8_t* codes, __m128i value)
+    {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes));
+        return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(c, value)));
+    }
+
+    static uint32_t matchMask16(const uint16_t* codes, __m128i value)
+    {
+        __m128i a = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(codes)), value);
+        __m128i b = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + 8)), value);
+        return uint32_t(_mm_movemask_epi8(_mm_packs_epi16(a, b)));
+    }
+
+    static uint32_t matchMask16(const uint32_t* codes, __m128i value)
+    {
+        __m128i a = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(codes)), value);
+        __m128i b = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + 4)), value);
+        __m128i c = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + 8)), value);
+        __m128i d = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + 12)), value);
+        return uint32_t(_mm_movemask_epi8(_mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d))));
+    }
+
+    static __m128i splat(uint8_t v)  { return _mm_set1_epi8(char(v)); }
+    static __m128i splat(uint16_t v) { return _mm_set1_epi16(short(v)); }
+    static __m128i splat(uint32_t v) { return _mm_set1_epi32(int(v)); }
+#endif
+
+    // sets the bit of every way whose code equals value, 64 ways per output word
+    template <class T>
+    static void matchEquals(const T* codes, T value, WayBitset& result)
+    {
+        const size_t n = result.size();
+        uint64_t* words = result.words();
+        size_t i = 0;
+
+#ifdef NLMAP_SSE2
+        const __m128i v = splat(value);
+        for (; i + 64 <= n; i += 64)
+        {
+            words[i / 64] = uint64_t(matchMask16(codes + i, v))
+                          | uint64_t(matchMask16(codes + i + 16, v)) << 16
+                          | uint64_t(matchMask16(codes + i + 32, v)) << 32
+                          | uint64_t(matchMask16(codes + i + 48, v)) << 48;
+        }
+#endif
+
+        // the scalar loop handles the tail, and everything on platforms without SSE2
+        for (; i < n; i++)
+        {
+            words[i / 64] |= uint64_t(codes[i] == value) << (i % 64);
+        }
+    }
+};
@@ -1,10 +1,22 @@
 #include "GUI.hpp"
+#include "Benchmark.hpp"
 
 #include <sstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
-int main()
+int main(int argc, char* argv[])
 {
+    // run the loading benchmarks without opening a window: sfmlgame --bench ways.txt [map.osm.pbf ...]
+    if (argc > 1 && std::string(argv[1]) == "--bench")
+    {
+        std::vector<std::string> filenames(argv + 2, argv + argc);
+        if (filenames.empty()) { filenames.push_back("ways.txt"); }
+        Benchmark::run(filenames);
+        return 0;
+    }
+
     GUI gui;
     gui.run();
 